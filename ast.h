@@ -0,0 +1,71 @@
+#ifndef AST_H_
+#define AST_H_
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+#include "lex.h"
+#include "val.h"
+
+//Index of a node in Program::nodes
+typedef uint32_t NodeId;
+const NodeId NONODE = UINT32_MAX;
+
+//Kinds of tree nodes, with the meaning of the a, b, c fields of each
+enum NodeKind : uint8_t {
+	//Expressions
+	N_CONST,			//a = index into consts, unused in a tree built only for checking
+	N_VAR,				//a = slot
+	N_NEG, N_NOT,			//a = operand
+	N_ADD, N_SUB, N_MUL, N_DIV, N_IDIV, N_MOD,
+	N_EQ, N_LTHAN, N_GTHAN, N_AND, N_OR,	//a, b = operands
+
+	//Statements
+	N_ASSIGN,			//a = slot, b = expression; type is the variable's
+	N_WRITE, N_WRITELN,		//a = first of b expressions in lists
+	N_IF,				//a = condition, b = then statement, c = else statement or NONODE
+	N_BLOCK,			//a = first of b statements in lists
+	N_INIT,				//a = first of b slots in lists, c = expression; type is theirs
+};
+
+struct Node {
+	NodeKind	kind;
+	ValType	type;		//static type, set by TypeCheck (by the parser for N_CONST)
+	int	line;
+	uint32_t	a, b, c;
+};
+
+//A parsed program. Nodes refer to each other by index and to variables by
+//slot, and variable length children (statement and expression lists,
+//declared names) are runs of the shared lists array
+struct Program {
+	vector<Node>	nodes;
+	vector<uint32_t>	lists;
+	vector<Value>	consts;
+	vector<NodeId>	inits;		//N_INIT nodes, in declaration order
+	vector<SymbolId>	vars;		//declared variables, indexed by slot
+	uint32_t	eliminated = 0;	//nodes removed by Optimize
+	NodeId	body = NONODE;		//the N_BLOCK of the main compound statement
+
+	NodeId Add(NodeKind kind, int line, uint32_t a = 0, uint32_t b = 0, uint32_t c = NONODE) {
+		nodes.push_back({kind, VERR, line, a, b, c});
+		return nodes.size() - 1;
+	}
+
+	uint32_t AddList(const vector<uint32_t>& items) {
+		lists.insert(lists.end(), items.begin(), items.end());
+		return lists.size() - items.size();
+	}
+
+	uint32_t AddConst(const Value& v) {
+		consts.push_back(v);
+		return consts.size() - 1;
+	}
+
+	const Node& operator[](NodeId id) const { return nodes[id]; }
+	const uint32_t* List(const Node& n) const { return lists.data() + n.a; }
+};
+
+#endif /* AST_H_ */
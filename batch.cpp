@@ -0,0 +1,210 @@
+/*
+Description: Batch driver. Lexes, parses and interprets many programs at
+	once on a work-stealing pool, each with its own Interpreter and output
+	buffer, then prints every program's output in the order the programs
+	were given, followed by the aggregate throughput on standard error.
+Usage: batch [-j threads] [-c cachedir] [-n] [-e engine] (file | directory | -) ...
+	A directory stands for the regular files in it, sorted by name, and -
+	reads file names from standard input, one per line. With -c, compiled
+	programs are kept in cachedir and unchanged sources are not parsed again.
+	With -n, programs are only checked for syntax, declarations and types.
+	With -e, they run on the given engine: tree, stack (the default),
+	register, jit or closure.
+*/
+
+#include "parserInterp.h"
+#include "workpool.h"
+#include "progcache.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+//What one program produced
+struct Result {
+	string	output;
+	bool	ok = false;
+	int	errors = 0;
+	size_t	tokens = 0;
+	size_t	bytes = 0;
+	size_t	eliminated = 0;	//nodes removed by Optimize
+};
+
+static void RunProgram(const string& file, const ProgramCache* cache, bool checkOnly, Engine engine, Result& r)
+{
+	ostringstream out;
+	Interpreter ctx(out);
+	ctx.engine = engine;
+	LexBuffer source;
+	if (!source.Open(file.c_str()))
+	{
+		out << "CANNOT OPEN THE FILE " << file << endl;
+		r.output = out.str();
+		r.errors = 1;
+		return;
+	}
+	string_view text(source.Begin(), source.End() - source.Begin());
+	r.bytes = text.size();
+
+	try
+	{
+		if (checkOnly)
+		{
+			TokenStream tokens;
+			tokens.Load(string(text));
+			TokenCursor cursor(tokens);
+			int line = 1;
+			r.tokens = tokens.Size();
+			r.ok = CheckProg(ctx, cursor, line);
+		}
+		else
+		{
+			Program program;
+			r.ok = CompileProgram(ctx, text, program, cache, &r.tokens) && Execute(ctx, program);
+			r.eliminated = program.eliminated;
+		}
+	}
+	catch (const char* msg)
+	{
+		//Value accessors throw on a type mismatch
+		out << msg << endl;
+		ctx.error_count++;
+		r.ok = false;
+	}
+	catch (const exception& e)
+	{
+		//Tasks of the pool must not throw, so nothing may escape here
+		out << e.what() << endl;
+		ctx.error_count++;
+		r.ok = false;
+	}
+	r.errors = ctx.error_count;
+	r.output = out.str();
+}
+
+//Adds the programs named by arg: a file, every file of a directory, or
+//the names read from standard input
+static bool AddPrograms(const string& arg, vector<string>& files)
+{
+	namespace fs = std::filesystem;
+	if (arg == "-")
+	{
+		string name;
+		while (getline(cin, name))
+		{
+			if (!name.empty())
+			{
+				files.push_back(name);
+			}
+		}
+		return true;
+	}
+
+	error_code ec;
+	if (!fs::is_directory(arg, ec))
+	{
+		files.push_back(arg);
+		return true;
+	}
+	vector<string> names;
+	for (const fs::directory_entry& e : fs::directory_iterator(arg, ec))
+	{
+		if (e.is_regular_file(ec))
+		{
+			names.push_back(e.path().string());
+		}
+	}
+	if (ec)
+	{
+		cerr << "CANNOT READ THE DIRECTORY " << arg << endl;
+		return false;
+	}
+	sort(names.begin(), names.end());
+	files.insert(files.end(), names.begin(), names.end());
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned threads = thread::hardware_concurrency();
+	unique_ptr<ProgramCache> cache;
+	bool checkOnly = false;
+	Engine engine = ENGINE_STACK;
+	vector<string> files;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-j" && i + 1 < argc)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if (arg == "-c" && i + 1 < argc)
+		{
+			cache.reset(new ProgramCache(argv[++i]));
+		}
+		else if (arg == "-n")
+		{
+			checkOnly = true;
+		}
+		else if (arg == "-e" && i + 1 < argc)
+		{
+			string name = argv[++i];
+			if (name == "tree")
+				engine = ENGINE_TREE;
+			else if (name == "stack")
+				engine = ENGINE_STACK;
+			else if (name == "register")
+				engine = ENGINE_REGISTER;
+			else if (name == "jit")
+				engine = ENGINE_JIT;
+			else if (name == "closure")
+				engine = ENGINE_CLOSURE;
+			else
+			{
+				cerr << "UNKNOWN ENGINE " << name << endl;
+				return 1;
+			}
+		}
+		else if (!AddPrograms(arg, files))
+		{
+			return 1;
+		}
+	}
+	if (files.empty())
+	{
+		cerr << "usage: " << argv[0] << " [-j threads] [-c cachedir] [-n] [-e engine] (file | directory | -) ..." << endl;
+		return 1;
+	}
+
+	WorkPool pool(threads);
+	vector<Result> results(files.size());
+	auto start = chrono::steady_clock::now();
+	pool.Run(files.size(), [&](size_t i) { RunProgram(files[i], cache.get(), checkOnly, engine, results[i]); });
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	size_t failed = 0, tokens = 0, bytes = 0, eliminated = 0;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const Result& r = results[i];
+		cout << "== " << files[i] << "\n" << r.output;
+		if (r.ok)
+			cout << "\n(DONE)\n";
+		else
+			cout << "\nUnsuccessful Interpretation\nNumber of Errors " << r.errors << "\n";
+		failed += !r.ok;
+		tokens += r.tokens;
+		bytes += r.bytes;
+		eliminated += r.eliminated;
+	}
+	cout.flush();
+
+	cerr << files.size() << " programs (" << failed << " unsuccessful), " << tokens << " tokens, "
+		<< bytes << " bytes in " << fixed << setprecision(3) << secs << " s on " << pool.Threads() << " threads: "
+		<< setprecision(0) << files.size() / secs << " programs/s, " << tokens / secs << " tokens/s; "
+		<< eliminated << " nodes eliminated by optimization" << endl;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+/*
+Description: Benchmark of expression parsing on very long and deeply nested
+	expressions. Each program is lexed once, then parsed into a Program
+	repeatedly; the time per token covers parsing and tree building only.
+Build: g++ -std=c++17 -O2 -I.. exprbench.cpp ../lex.cpp ../lexsimd.cpp ../intern.cpp ../tokstream.cpp ../val.cpp ../parsinterp.cpp ../typecheck.cpp ../optimize.cpp ../exec.cpp ../compile.cpp ../vm.cpp ../regcompile.cpp ../regvm.cpp ../jit.cpp ../closure.cpp -pthread -o exprbench
+*/
+
+#include "parserInterp.h"
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+static const char *binops[] = {"+", "-", "*", "/", "idiv", "mod", "+", "*"};
+
+static string Header()
+{
+	return "program bench;\nvar\n\tx, y : integer := 3;\n\tb : boolean := true;\nbegin\n";
+}
+
+//One writeln of a flat expression with n operands across all arithmetic levels
+static string Long(int n)
+{
+	ostringstream out;
+	out << Header() << "\twriteln(x";
+	for (int i = 1; i < n; i++)
+	{
+		out << ' ' << binops[i % 8] << ' ' << (i % 3 == 0 ? "y" : "2");
+	}
+	out << ")\nend.\n";
+	return out.str();
+}
+
+//An assignment nested depth parentheses deep, with a comparison and an
+//arithmetic operator at every level
+static string Deep(int depth)
+{
+	ostringstream out;
+	out << Header() << "\tb := ";
+	for (int i = 0; i < depth; i++)
+	{
+		out << "(x < y + " << i << ") and (b = ";
+	}
+	out << "b";
+	for (int i = 0; i < depth; i++)
+	{
+		out << ")";
+	}
+	out << "\nend.\n";
+	return out.str();
+}
+
+//Many short statements, closer to ordinary programs
+static string Typical(int stmts)
+{
+	ostringstream out;
+	out << Header();
+	for (int i = 0; i < stmts; i++)
+	{
+		out << "\tx := x * 2 + y mod 7 - (y + " << i << ") idiv 3;\n";
+		out << "\tif x > y and b = false then y := y + 1 else y := y - 1;\n";
+	}
+	out << "\twriteln(x, y)\nend.\n";
+	return out.str();
+}
+
+static bool Measure(const char *name, const string &src, int rounds)
+{
+	TokenStream tokens;
+	tokens.Load(src);
+	int line = 1;
+
+	auto start = chrono::steady_clock::now();
+	size_t nodes = 0;
+	for (int r = 0; r < rounds; r++)
+	{
+		TokenCursor cursor(tokens);
+		Interpreter ctx;
+		Program program;
+		if (!ParseProg(ctx, cursor, line, program))
+		{
+			cout << name << ": parse failed" << endl;
+			return false;
+		}
+		nodes = program.nodes.size();
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	cout << left << setw(10) << name << right << setw(9) << tokens.Size() << " tokens "
+		<< setw(9) << nodes << " nodes " << fixed << setprecision(2)
+		<< setw(8) << secs / rounds / tokens.Size() * 1e9 << " ns/token" << endl;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 20;
+
+	bool ok = Measure("long", Long(200000), rounds)
+		&& Measure("deep", Deep(2000), rounds)
+		&& Measure("typical", Typical(20000), rounds);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+/*
+Description: Microbenchmark of keyword recognition in id_or_kw against the
+	previous map-based implementation, on identifier-heavy input
+Build: g++ -std=c++17 -O2 -I.. kwbench.cpp ../lex.cpp ../lexsimd.cpp ../intern.cpp -o kwbench
+*/
+
+#include "lex.h"
+#include <chrono>
+#include <vector>
+#include <iomanip>
+
+//The map-based id_or_kw this benchmark measures against
+static LexItem id_or_kw_map(string_view lexeme, int linenum)
+{
+	std::map<std::string, Token> keywords = {
+		{"and", AND}, {"begin", BEGIN}, {"boolean", BOOLEAN}, {"idiv", IDIV}, {"else", ELSE}, {"false", FALSE},
+		{"if", IF}, {"integer", INTEGER}, {"mod", MOD}, {"not", NOT}, {"or", OR}, {"program", PROGRAM},
+		{"real", REAL}, {"string", STRING}, {"then", THEN}, {"true", TRUE}, {"write", WRITE}, {"writeln", WRITELN}, {"var", VAR}, {"end", END}
+	};
+
+	for (auto &i : keywords)
+	{
+		if (lexeme == i.first)
+		{
+			if (i.second == TRUE || i.second == FALSE)
+				return LexItem(BCONST, lexeme, linenum);
+			return LexItem(i.second, lexeme, linenum);
+		}
+	}
+	return LexItem(IDENT, lexeme, linenum);
+}
+
+template <class F>
+static double Run(const vector<string> &words, int rounds, F classify, long &checksum)
+{
+	auto start = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (const string &w : words)
+		{
+			checksum += classify(w, r).GetToken();
+		}
+	}
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 200;
+
+	//Mostly identifiers, some of them keyword prefixes, with keywords mixed in
+	const char *samples[] = {
+		"i", "j", "count", "total", "begin", "x1", "sum$", "tmp_2", "writeln", "end",
+		"integerValue", "realPart", "if", "then", "els", "endx", "string", "var", "mod", "a"};
+	vector<string> words;
+	for (int i = 0; i < 1000; i++)
+	{
+		words.push_back(samples[(i * 7) % 20]);
+	}
+
+	for (const string &w : words)
+	{
+		if (id_or_kw(w, 0).GetToken() != id_or_kw_map(w, 0).GetToken())
+		{
+			cout << "MISMATCH on " << w << endl;
+			return 1;
+		}
+	}
+
+	long sum1 = 0, sum2 = 0;
+	double tmap = Run(words, rounds / 10 + 1, id_or_kw_map, sum1);
+	double thash = Run(words, rounds, id_or_kw, sum2);
+	double nmap = double(words.size()) * (rounds / 10 + 1);
+	double nhash = double(words.size()) * rounds;
+
+	cout << "map lookup:     " << fixed << setprecision(2) << tmap / nmap * 1e9 << " ns/ident" << endl;
+	cout << "perfect hash:   " << thash / nhash * 1e9 << " ns/ident" << endl;
+	cout << "speedup:        " << (tmap / nmap) / (thash / nhash) << "x" << endl;
+	cout << "checksum:       " << sum1 + sum2 << endl;
+	return 0;
+}
@@ -0,0 +1,70 @@
+/*
+Description: Scaling benchmark for parallel lexing. Lexes one large source
+	file with 1 to N threads, checks every run against the sequential token
+	stream and reports throughput and speedup.
+Build: g++ -std=c++17 -O2 -pthread -I.. lexscale.cpp ../lex.cpp ../lexsimd.cpp ../intern.cpp ../tokstream.cpp -o lexscale
+Usage: lexscale program.pas [max-threads]
+*/
+
+#include "tokstream.h"
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+static bool SameTokens(const TokenStream &a, const TokenStream &b)
+{
+	if (a.Size() != b.Size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a.Size(); i++)
+	{
+		if (a.Kind(i) != b.Kind(i) || a.Line(i) != b.Line(i) || a.Lexeme(i) != b.Lexeme(i))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		cout << "usage: lexscale program.pas [max-threads]" << endl;
+		return 1;
+	}
+	unsigned maxThreads = argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency();
+	if (maxThreads == 0)
+	{
+		maxThreads = 1;
+	}
+
+	LexBuffer probe;
+	if (!probe.Open(argv[1]))
+	{
+		cout << "CANNOT OPEN THE FILE " << argv[1] << endl;
+		return 1;
+	}
+	double mb = (probe.End() - probe.Begin()) / 1e6;
+
+	TokenStream reference;
+	reference.Open(argv[1]);
+
+	double base = 0;
+	for (unsigned t = 1; t <= maxThreads; t++)
+	{
+		TokenStream toks;
+		auto start = chrono::steady_clock::now();
+		toks.Open(argv[1], 1, t);
+		double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (t == 1)
+		{
+			base = secs;
+		}
+
+		cout << setw(3) << t << " threads: " << fixed << setprecision(1) << setw(8) << mb / secs << " MB/s  speedup "
+			 << setprecision(2) << base / secs << (SameTokens(reference, toks) ? "" : "  MISMATCH") << endl;
+	}
+	return 0;
+}
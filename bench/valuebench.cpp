@@ -0,0 +1,118 @@
+/*
+Description: Benchmark of the Value class: its size, the memory held by a
+	million Values of each type, and the time per operator call and per
+	copy. Only the public interface is used, so the same file builds against
+	any version of val.h for a before and after comparison.
+Build: g++ -std=c++17 -O2 -I.. valuebench.cpp ../val.cpp -o valuebench
+*/
+
+#include "val.h"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <vector>
+
+//Heap bytes currently allocated, counted by the replaced operator new
+static size_t heapBytes = 0;
+
+void* operator new(size_t n)
+{
+	size_t* p = static_cast<size_t*>(malloc(n + sizeof(size_t) * 2));
+	if (!p)
+	{
+		throw bad_alloc();
+	}
+	*p = n;
+	heapBytes += n;
+	return p + 2;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr)
+	{
+		size_t* p = static_cast<size_t*>(ptr) - 2;
+		heapBytes -= *p;
+		free(p);
+	}
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+static const int N = 1000000;
+
+//Bytes held by a vector of N Values made by make, counting their heap data
+static void Footprint(const char* name, const function<Value(int)>& make)
+{
+	size_t before = heapBytes;
+	{
+		vector<Value> values;
+		values.reserve(N);
+		for (int i = 0; i < N; i++)
+		{
+			values.push_back(make(i));
+		}
+		size_t bytes = heapBytes - before;
+		cout << left << setw(28) << name << right << setw(12) << bytes << " bytes " << fixed << setprecision(1)
+			<< setw(8) << double(bytes) / N << " bytes/value" << endl;
+	}
+}
+
+static volatile int sink;
+
+//Nanoseconds per call of op over pairs from values, best of several runs
+static void Throughput(const char* name, const vector<Value>& values, const function<int(const Value&, const Value&)>& op)
+{
+	double best = 1e30;
+	for (int round = 0; round < 5; round++)
+	{
+		int acc = 0;
+		auto start = chrono::steady_clock::now();
+		for (size_t i = 0; i + 1 < values.size(); i++)
+		{
+			acc += op(values[i], values[i + 1]);
+		}
+		double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		best = min(best, secs);
+		sink = acc;
+	}
+	cout << left << setw(28) << name << right << fixed << setprecision(2) << setw(8)
+		<< best / (values.size() - 1) * 1e9 << " ns/op" << endl;
+}
+
+int main()
+{
+	cout << "sizeof(Value) = " << sizeof(Value) << endl << endl;
+
+	string shortText = "abc";
+	string longText = "a string longer than any small-string buffer";
+	Value sharedLong(longText);
+	Footprint("integers", [](int i) { return Value(i); });
+	Footprint("reals", [](int i) { return Value(i * 0.5); });
+	Footprint("short strings", [&](int) { return Value(shortText); });
+	Footprint("copies of one long string", [&](int) { return sharedLong; });
+
+	vector<Value> ints, reals, strs, bools;
+	for (int i = 0; i < N; i++)
+	{
+		ints.push_back(Value(i % 1000 + 1));
+		reals.push_back(Value(i % 1000 + 0.5));
+		strs.push_back(Value(i % 2 ? shortText : longText));
+		bools.push_back(Value(i % 3 == 0));
+	}
+
+	cout << endl;
+	Throughput("int +", ints, [](const Value& a, const Value& b) { return (a + b).GetInt(); });
+	Throughput("int * and idiv", ints, [](const Value& a, const Value& b) { return (a * b).idiv(b).GetInt(); });
+	Throughput("real * int", reals, [](const Value& a, const Value&) { return int((a * Value(3)).GetReal()); });
+	Throughput("int < real", ints, [](const Value& a, const Value&) { return (a < Value(500.5)).GetBool(); });
+	Throughput("string ==", strs, [](const Value& a, const Value& b) { return (a == b).GetBool(); });
+	Throughput("bool or", bools, [](const Value& a, const Value& b) { return (a || b).GetBool(); });
+	Throughput("copy int", ints, [](const Value& a, const Value&) { Value c = a; return c.GetInt(); });
+	Throughput("copy long string", strs, [](const Value& a, const Value&) { Value c = a; return int(c.GetString().size()); });
+	return 0;
+}
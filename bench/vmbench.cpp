@@ -0,0 +1,245 @@
+/*
+Description: Benchmark of the execution engines on arithmetic-heavy
+	programs: the tree walker of exec.cpp, also from source every time
+	(reparse), the closures of closure.cpp, the stack machine and the
+	register machine, and the x86-64 code of jit.cpp. For each it reports
+	the size of the code it runs (tree nodes, tokens, closures,
+	instructions, or bytes of machine code), the time to compile the tree, and the
+	time to run the compiled form, best of several rounds. The stack machine
+	runs without superinstructions, then with them (stack+); built with
+	-DVM_STATS it also reports how many of the operators run were fused.
+	The guards program measures the short-circuiting of and and or; the
+	blocks programs run the same statements around untaken branches of
+	growing size.
+Build: g++ -std=c++17 -O2 -I.. vmbench.cpp ../lex.cpp ../lexsimd.cpp ../intern.cpp ../tokstream.cpp ../val.cpp ../parsinterp.cpp ../typecheck.cpp ../optimize.cpp ../exec.cpp ../compile.cpp ../vm.cpp ../regcompile.cpp ../regvm.cpp ../jit.cpp ../closure.cpp -pthread -o vmbench
+*/
+
+#include "parserInterp.h"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+//Integer statements chaining + - * and mod, as SimpleExpr and Term do
+static string Integers(int stmts)
+{
+	ostringstream s;
+	s << "program ints;\nvar\n\tx, y, z : integer := 7;\nbegin\n";
+	for (int i = 0; i < stmts; i++)
+	{
+		s << "\tx := (x * 3 + y - z * 2 + (y - " << i % 13 << ") * 4 - x) mod 1000 + 1;\n"
+			<< "\ty := (y * x - z + " << i % 7 << " * x - y * 2) mod 997 + 2;\n"
+			<< "\tz := x + y * 2 - (z mod 5) * 3;\n";
+	}
+	s << "\twriteln(x, ' ', y, ' ', z)\nend.\n";
+	return s.str();
+}
+
+//Real and mixed arithmetic, with the conversions Value's operators make
+static string Reals(int stmts)
+{
+	ostringstream s;
+	s << "program reals;\nvar\n\ta, b : real := 1.5;\n\tn : integer := 3;\nbegin\n";
+	for (int i = 0; i < stmts; i++)
+	{
+		s << "\ta := a * 0.5 + b * n - (a - " << i % 11 << ".25) * 0.125;\n"
+			<< "\tb := (b + a * 2) * 0.25 - n * 1.5 + a / 4.0;\n";
+	}
+	s << "\twriteln(a, ' ', b)\nend.\n";
+	return s.str();
+}
+
+//Arithmetic under conditions, half the branches taken
+static string Branches(int stmts)
+{
+	ostringstream s;
+	s << "program branches;\nvar\n\tx, y : integer := 1;\n\tb : boolean := true;\nbegin\n";
+	for (int i = 0; i < stmts; i++)
+	{
+		s << "\tif x > y and b then x := (x * 7 + y) mod 1009 else y := (y * 5 + x * 3) mod 1013;\n"
+			<< "\tb := (x mod 2 = 0) or (y < " << i % 500 << ");\n";
+	}
+	s << "\twriteln(x, ' ', y)\nend.\n";
+	return s.str();
+}
+
+//Guard-style conditions: the left operand of and or or usually decides
+//the result, or protects the right one from a division by zero
+static string Guards(int stmts)
+{
+	ostringstream s;
+	s << "program guards;\nvar\n\tx, y, z, d : integer := 1;\n\tb : boolean := true;\nbegin\n";
+	for (int i = 0; i < stmts; i++)
+	{
+		s << "\td := (x + " << i % 5 << ") mod 4;\n"
+			<< "\tif (d > 0) and ((x * 3 + y) mod d + (y * 7 - z) mod d > (z * 5 + x) mod d) then x := (x * 7 + y) mod 1009 else y := (y * 5 + d) mod 1013;\n"
+			<< "\tb := (x mod 8 > 0) or ((y * 7 + x * 3 - z) mod 11 = (x * y + z * 5) mod 13);\n"
+			<< "\tif b or (z * 3 - x * y mod 7 > y * 2 + z mod 5) then z := (z + x) mod 1019;\n";
+	}
+	s << "\twriteln(x, ' ', y, ' ', z)\nend.\n";
+	return s.str();
+}
+
+//Large conditional blocks, nested, of which only a few statements run:
+//skipping an untaken block costs the same whatever its size
+static string Blocks(int blocks, int size)
+{
+	ostringstream s;
+	s << "program blocks;\nvar\n\tx, y : integer := 1;\nbegin\n";
+	for (int i = 0; i < blocks; i++)
+	{
+		s << "\tif x > y + " << 2000 + i % 7 << " then\n\tbegin\n";
+		for (int k = 0; k < size; k++)
+		{
+			s << "\t\tx := (x * 7 + y - " << k % 9 << ") mod 1009;\n"
+				<< "\t\tif y > x then begin y := y - x; x := x + 1 end else y := (y * 3 + x) mod 1013;\n";
+		}
+		s << "\t\ty := 0\n\tend\n\telse if y > " << 1000 + i % 5 << " then\n\tbegin\n";
+		for (int k = 0; k < size; k++)
+		{
+			s << "\t\ty := (y * 5 + x) mod 1013;\n";
+		}
+		s << "\t\tx := 0\n\tend\n\telse\n\t\tx := (x * 3 + y) mod 1009;\n"
+			<< "\ty := (y + x + " << i % 11 << ") mod 997;\n";
+	}
+	s << "\twriteln(x, ' ', y)\nend.\n";
+	return s.str();
+}
+
+//Best time in milliseconds of f over rounds runs
+static double Best(int rounds, const function<void()>& f)
+{
+	double best = 1e30;
+	for (int round = 0; round < rounds; round++)
+	{
+		auto start = chrono::steady_clock::now();
+		f();
+		best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	}
+	return best * 1e3;
+}
+
+static void Report(const char* engine, size_t size, double compile, double run, const string& out, const string& expected)
+{
+	cout << "  " << left << setw(10) << engine << right << setw(10) << size << " code "
+		<< fixed << setprecision(2) << setw(9) << compile << " ms compile " << setw(9) << run << " ms run"
+		<< (out == expected ? "" : "  OUTPUT DIFFERS") << endl;
+}
+
+static bool Measure(const char* name, const string& source, int rounds)
+{
+	TokenStream tokens;
+	tokens.Load(source);
+	TokenCursor cursor(tokens);
+	int line = 1;
+	ostringstream errors;
+	Interpreter parse(errors);
+	Program program;
+	if (!ParseProg(parse, cursor, line, program))
+	{
+		cout << name << ": parse failed\n" << errors.str();
+		return false;
+	}
+	Optimize(program);
+	cout << name << ": " << tokens.Size() << " tokens" << endl;
+
+	//Each run gets a fresh context, as Execute would
+	auto run = [&](const function<void(Interpreter&)>& f) {
+		ostringstream out;
+		Interpreter ctx(out);
+		f(ctx);
+		return out.str();
+	};
+
+	string expected;
+	double tree = Best(rounds, [&] {
+		expected = run([&](Interpreter& ctx) { ctx.engine = ENGINE_TREE; Execute(ctx, program); });
+	});
+	Report("tree", program.nodes.size(), 0, tree, expected, expected);
+
+	//Running from source every time: lexing, parsing and optimizing, then
+	//walking the tree
+	string out;
+	double reparse = Best(rounds, [&] {
+		out = run([&](Interpreter& ctx) {
+			TokenStream again;
+			again.Load(source);
+			TokenCursor in(again);
+			int at = 1;
+			Program parsed;
+			if (ParseProg(ctx, in, at, parsed))
+			{
+				Optimize(parsed);
+				ctx.engine = ENGINE_TREE;
+				Execute(ctx, parsed);
+			}
+		});
+	});
+	Report("reparse", tokens.Size(), 0, reparse, out, expected);
+
+	ClosureProgram closures;
+	double compile = Best(rounds, [&] { CompileClosures(program, closures); });
+	double closure = Best(rounds, [&] { out = run([&](Interpreter& ctx) { ExecuteClosures(ctx, closures); }); });
+	Report("closure", closures.closures, compile, closure, out, expected);
+
+	Chunk chunk;
+	compile = Best(rounds, [&] { Compile(program, chunk, false); });
+	double stack = Best(rounds, [&] { out = run([&](Interpreter& ctx) { ExecuteChunk(ctx, chunk); }); });
+	Report("stack", chunk.code.size(), compile, stack, out, expected);
+
+	compile = Best(rounds, [&] { Compile(program, chunk); });
+	stack = Best(rounds, [&] { out = run([&](Interpreter& ctx) { ExecuteChunk(ctx, chunk); }); });
+	Report("stack+", chunk.code.size(), compile, stack, out, expected);
+	cout << "  " << chunk.fused << " instructions fused into superinstructions" << endl;
+
+	NativeCode native;
+	compile = Best(rounds, [&] { CompileNative(chunk, native); });
+	if (native.code)
+	{
+		double jit = Best(rounds, [&] { out = run([&](Interpreter& ctx) { ExecuteNative(ctx, chunk, native); }); });
+		Report("jit", native.size, compile, jit, out, expected);
+	}
+	else
+	{
+		cout << "  no jit" << endl;
+	}
+#ifdef VM_STATS
+	{
+		ostringstream sink;
+		Interpreter ctx(sink);
+		ExecuteChunk(ctx, chunk);
+		uint64_t total = 0, fused = 0, operators = 0;
+		for (int op = 0; op < OP_COUNT; op++)
+		{
+			total += ctx.executed[op];
+			if (IsFused(OpCode(op)))
+				fused += ctx.executed[op];
+			else if (op >= OP_ADD_I && op <= OP_GT_R)
+				operators += ctx.executed[op];
+		}
+		cout << "  " << total << " instructions run, " << fused << " of them superinstructions: "
+			<< fixed << setprecision(1) << 100.0 * fused / max<uint64_t>(fused + operators, 1)
+			<< "% of operators fused" << endl;
+	}
+#endif
+
+	RegChunk regs;
+	compile = Best(rounds, [&] { CompileRegisters(program, regs); });
+	double reg = Best(rounds, [&] { out = run([&](Interpreter& ctx) { ExecuteRegisters(ctx, regs); }); });
+	Report("register", regs.code.size(), compile, reg, out, expected);
+	cout << "  " << regs.registers - regs.vars - regs.consts.size() - regs.strings.size() << " temporary registers" << endl;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 10;
+
+	bool ok = Measure("integers", Integers(20000), rounds)
+		&& Measure("reals", Reals(20000), rounds)
+		&& Measure("branches", Branches(20000), rounds)
+		&& Measure("guards", Guards(10000), rounds)
+		&& Measure("blocks", Blocks(1000, 5), rounds)
+		&& Measure("large blocks", Blocks(1000, 100), rounds);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#ifndef BYTECODE_H_
+#define BYTECODE_H_
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+#include "val.h"
+
+//Instructions of the stack machine, one operation for each operand type.
+//Operands are taken from the top of the stack and the result replaces
+//them; a is the instruction's immediate operand
+#define OPCODES(X) \
+	X(OP_PUSH)		/* push consts[a] */ \
+	X(OP_PUSH_S)		/* push strings[a] */ \
+	X(OP_LOAD_I) X(OP_LOAD_R) X(OP_LOAD_B) X(OP_LOAD_S)	/* push variable a */ \
+	X(OP_STORE_I) X(OP_STORE_R) X(OP_STORE_B) X(OP_STORE_S)	/* pop into variable a */ \
+	X(OP_DUP) \
+	X(OP_I2R)		/* int to real */ \
+	X(OP_I2F)		/* int to real through float, as in Value's mixed operators */ \
+	X(OP_R2I)		/* real to int, truncating */ \
+	X(OP_NEG_I) X(OP_NEG_R) X(OP_NOT) \
+	X(OP_ADD_I) X(OP_SUB_I) X(OP_MUL_I) X(OP_DIV_I) X(OP_MOD_I) \
+	X(OP_ADD_R) X(OP_SUB_R) X(OP_MUL_R) \
+	X(OP_DIV_IR)		/* int divided by real */ \
+	X(OP_EQ_I) X(OP_EQ_R) X(OP_EQ_B) X(OP_EQ_S) \
+	X(OP_LT_I) X(OP_GT_I) X(OP_LT_R) X(OP_GT_R) \
+	/* Superinstructions: a binary operator whose right operand is */ \
+	/* constant a (_C) or variable a (_V), fused by the compiler */ \
+	X(OP_ADD_IC) X(OP_SUB_IC) X(OP_MUL_IC) X(OP_DIV_IC) X(OP_MOD_IC) \
+	X(OP_EQ_IC) X(OP_LT_IC) X(OP_GT_IC) \
+	X(OP_ADD_RC) X(OP_SUB_RC) X(OP_MUL_RC) X(OP_EQ_RC) X(OP_LT_RC) X(OP_GT_RC) \
+	X(OP_ADD_IV) X(OP_SUB_IV) X(OP_MUL_IV) X(OP_EQ_IV) X(OP_LT_IV) X(OP_GT_IV) \
+	X(OP_ADD_RV) X(OP_SUB_RV) X(OP_MUL_RV) X(OP_EQ_RV) X(OP_LT_RV) X(OP_GT_RV) \
+	X(OP_JUMP)		/* continue at a */ \
+	X(OP_JUMP_FALSE)	/* pop, and continue at a if false */ \
+	X(OP_AND_JUMP)	/* continue at a if false, else pop */ \
+	X(OP_OR_JUMP)	/* continue at a if true, else pop */ \
+	X(OP_WRITE_I) X(OP_WRITE_R) X(OP_WRITE_B) X(OP_WRITE_S)	/* pop and write */ \
+	X(OP_WRITELN)		/* write a newline */ \
+	X(OP_HALT)
+
+#define OPCODE_ENUM(op) op,
+enum OpCode : uint8_t { OPCODES(OPCODE_ENUM) OP_COUNT };
+
+//Whether op is one of the superinstructions
+inline bool IsFused(OpCode op)
+{
+	return op >= OP_ADD_IC && op <= OP_GT_RV;
+}
+
+struct Instr {
+	OpCode	op;
+	uint32_t	a;
+};
+
+//An element of the machine's stack or constant pool; the type of every
+//cell is known from the instruction using it. Strings are the Values they
+//are held in
+union Cell {
+	int	i;
+	double	r;
+	bool	b;
+	const Value	*s;
+};
+
+//Instructions from pc on, up to the next entry, come from line
+struct LineStart {
+	uint32_t	pc;
+	int	line;
+};
+
+//Line of the instruction at pc in a line table
+inline int LineAt(const vector<LineStart>& lines, uint32_t pc)
+{
+	auto next = upper_bound(lines.begin(), lines.end(), pc, [](uint32_t pc, const LineStart& l) { return pc < l.pc; });
+	return next == lines.begin() ? 0 : next[-1].line;
+}
+
+//A program compiled for the stack machine
+struct Chunk {
+	vector<Instr>	code;
+	vector<LineStart>	lines;		//in pc order, one entry per change of line
+	vector<Cell>	consts;		//integer, real and boolean constants
+	vector<Value>	strings;	//string constants
+	uint32_t	vars = 0;		//number of variable slots
+	uint32_t	maxStack = 0;	//deepest the stack gets
+	uint32_t	fused = 0;		//instructions folded into superinstructions
+
+	//Line of the instruction at pc, for reporting a runtime error there
+	int Line(uint32_t pc) const { return LineAt(lines, pc); }
+};
+
+//Instructions of the register machine. Every operand is a register: the
+//variables by slot, then the constants, then the temporaries. d is the
+//destination, a and b the operands
+#define REGCODES(X) \
+	X(R_MOVE)		/* d = a */ \
+	X(R_CHECK)		/* fail unless variable a has been assigned */ \
+	X(R_MARK)		/* variable a has been assigned */ \
+	X(R_I2R) X(R_I2F) X(R_R2I)	/* d = a converted, as OP_I2R, OP_I2F, OP_R2I */ \
+	X(R_NEG_I) X(R_NEG_R) X(R_NOT) \
+	X(R_ADD_I) X(R_SUB_I) X(R_MUL_I) X(R_DIV_I) X(R_MOD_I) \
+	X(R_ADD_R) X(R_SUB_R) X(R_MUL_R) X(R_DIV_IR) \
+	X(R_EQ_I) X(R_EQ_R) X(R_EQ_B) X(R_EQ_S) \
+	X(R_LT_I) X(R_GT_I) X(R_LT_R) X(R_GT_R) \
+	X(R_JUMP)		/* continue at d */ \
+	X(R_JUMP_FALSE)	/* continue at d if a is false */ \
+	X(R_JUMP_TRUE)	/* continue at d if a is true */ \
+	X(R_WRITE_I) X(R_WRITE_R) X(R_WRITE_B) X(R_WRITE_S)	/* write a */ \
+	X(R_WRITELN) \
+	X(R_HALT)
+
+enum RegCode : uint8_t { REGCODES(OPCODE_ENUM) R_COUNT };
+
+struct RegInstr {
+	RegCode	op;
+	uint32_t	d, a, b;
+};
+
+//A program compiled for the register machine. The registers after the
+//variables start out holding consts, then strings
+struct RegChunk {
+	vector<RegInstr>	code;
+	vector<LineStart>	lines;
+	vector<Cell>	consts;
+	vector<Value>	strings;
+	uint32_t	vars = 0;
+	uint32_t	registers = 0;	//variables, constants and temporaries
+
+	int Line(uint32_t pc) const { return LineAt(lines, pc); }
+};
+
+//Machine code jit.cpp made from a Chunk, in an executable mapping that is
+//unmapped with it
+struct NativeCode {
+	void*	code = nullptr;
+	size_t	size = 0;
+
+	NativeCode() = default;
+	NativeCode(const NativeCode&) = delete;
+	NativeCode& operator=(const NativeCode&) = delete;
+	~NativeCode();
+};
+
+#undef OPCODE_ENUM
+
+#endif /* BYTECODE_H_ */
@@ -0,0 +1,740 @@
+/*
+Description: Compiles a program tree into closures: every expression
+	becomes a callable returning its static type, built from the callables
+	of its operands with the operator and any conversion bound in, and
+	every statement a callable running them. Running the program is then a
+	chain of direct calls, with no node kinds or types looked at. A long
+	left-deep chain of operators, such as a + b - c + ..., becomes one
+	callable looping over a callable per operator, so that neither
+	compiling nor running it recurses once per operator. The conversions
+	and the order of evaluation are exec.cpp's, and so is the reporting of
+	runtime errors.
+*/
+
+#include "parserInterp.h"
+#include <climits>
+
+namespace {
+
+//Thrown out of the closures once a runtime error has been reported
+struct RuntimeError {};
+
+[[noreturn]] void Fail(Interpreter& ctx, int line, const char* msg)
+{
+	ParseError(ctx, line, msg);
+	throw RuntimeError();
+}
+
+//Variable slot, which holds a Value of its declared type t once assigned
+const Value& Load(ClosureFrame& f, uint32_t slot, ValType t, int line)
+{
+	const Value& v = f.vars[slot];
+	if (v.GetType() != t)
+	{
+		Fail(f.ctx, line, "Using uninitialzied variable");
+	}
+	return v;
+}
+
+//left op right, the left operand evaluated first. Operands are moved in:
+//copying one copies every callable below it
+template <class Code, class Op>
+auto Binary(Code left, Code right, Op op)
+{
+	return [left = std::move(left), right = std::move(right), op](ClosureFrame& f) {
+		auto v1 = left(f);
+		return op(v1, right(f));
+	};
+}
+
+//left op k, for a constant right operand k
+template <class Code, class T, class Op>
+auto WithConstant(Code left, T k, Op op)
+{
+	return [left = std::move(left), k, op](ClosureFrame& f) { return op(left(f), k); };
+}
+
+//The value of an arithmetic chain so far, in i or in r as its type says
+struct Number {
+	int	i = 0;
+	double	r = 0;
+};
+
+//One operator of a chain, applied to the value so far
+typedef function<void(ClosureFrame&, Number&)>	StepCode;
+
+bool Arithmetic(const Node& n)
+{
+	return n.kind >= N_ADD && n.kind <= N_MOD;
+}
+
+//Chains of up to this many arithmetic operators become nested closures,
+//which run faster than the steps of a longer one
+const size_t SHORT_CHAIN = 16;
+
+//Whether id ends a left-deep chain of more than SHORT_CHAIN arithmetic
+//operators
+bool LongChain(const Program& prog, NodeId id)
+{
+	size_t length = 0;
+	for (; Arithmetic(prog[id]); id = prog[id].a)
+	{
+		if (++length > SHORT_CHAIN)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//value op= right, on the int or the real of the value
+template <class T, class Code, class Op>
+StepCode Step(T Number::*value, Code right, Op op)
+{
+	return [value, right = std::move(right), op](ClosureFrame& f, Number& v) { v.*value = op(v.*value, right(f)); };
+}
+
+//value op= k, for a constant right operand k
+template <class T, class Op>
+StepCode StepConstant(T Number::*value, T k, Op op)
+{
+	return [value, k, op](ClosureFrame&, Number& v) { v.*value = op(v.*value, k); };
+}
+
+//Runs the steps of a chain in order and gives its value
+template <class T>
+function<T(ClosureFrame&)> Fold(vector<StepCode> steps, T Number::*value)
+{
+	return [steps = std::move(steps), value](ClosureFrame& f) {
+		Number v;
+		for (const StepCode& step : steps)
+		{
+			step(f, v);
+		}
+		return v.*value;
+	};
+}
+
+//Assigns the value of e, converted to Value, to each of slots
+template <class Code>
+StmtCode Assign(const vector<uint32_t>& slots, Code e)
+{
+	if (slots.size() == 1)
+	{
+		uint32_t slot = slots[0];
+		return [slot, e = std::move(e)](ClosureFrame& f) { f.vars[slot] = Value(e(f)); };
+	}
+	return [slots, e = std::move(e)](ClosureFrame& f) {
+		Value v(e(f));
+		for (uint32_t slot : slots)
+		{
+			f.vars[slot] = v;
+		}
+	};
+}
+
+//Writes the value of e as the Value it stands for
+template <class Code>
+StmtCode Write(Code e)
+{
+	return [e = std::move(e)](ClosureFrame& f) { f.ctx.out << Value(e(f)); };
+}
+
+struct ClosureCompiler {
+	const Program&	prog;
+	uint32_t	closures = 0;
+
+	IntCode Int(NodeId id);
+	RealCode Real(NodeId id);
+	BoolCode Bool(NodeId id);
+	StringCode String(NodeId id);
+	RealCode Widened(NodeId id);
+	RealCode AsReal(NodeId id);
+	IntCode Dividend(NodeId id);
+	vector<StepCode> Chain(NodeId id);
+	StepCode Operator(const Node& n);
+	StmtCode Store(const Node& n, NodeId expr, const vector<uint32_t>& slots);
+	StmtCode Stmt(NodeId id);
+};
+
+IntCode ClosureCompiler::Int(NodeId id)
+{
+	const Node& n = prog[id];
+	closures++;
+	if (LongChain(prog, id))
+	{
+		return Fold(Chain(id), &Number::i);
+	}
+	switch (n.kind)
+	{
+	case N_CONST:
+	{
+		int k = prog.consts[n.a].GetInt();
+		return [k](ClosureFrame&) { return k; };
+	}
+	case N_VAR:
+	{
+		uint32_t slot = n.a;
+		int line = n.line;
+		return [slot, line](ClosureFrame& f) { return Load(f, slot, VINT, line).GetInt(); };
+	}
+	case N_NEG:
+	{
+		IntCode e = Int(n.a);
+		return [e = std::move(e)](ClosureFrame& f) { return -e(f); };
+	}
+	case N_ADD:
+	case N_SUB:
+	case N_MUL:
+	{
+		IntCode left = Int(n.a);
+		const Node& r = prog[n.b];
+		if (r.kind == N_CONST)
+		{
+			int k = prog.consts[r.a].GetInt();
+			switch (n.kind)
+			{
+			case N_ADD:	return WithConstant(std::move(left), k, plus<int>());
+			case N_SUB:	return WithConstant(std::move(left), k, minus<int>());
+			default:	return WithConstant(std::move(left), k, multiplies<int>());
+			}
+		}
+		IntCode right = Int(n.b);
+		switch (n.kind)
+		{
+		case N_ADD:	return Binary(std::move(left), std::move(right), plus<int>());
+		case N_SUB:	return Binary(std::move(left), std::move(right), minus<int>());
+		default:	return Binary(std::move(left), std::move(right), multiplies<int>());
+		}
+	}
+	case N_DIV:
+	case N_IDIV:
+	case N_MOD:
+	{
+		IntCode left = n.kind == N_MOD ? Int(n.a) : Dividend(n.a);
+		const Node& r = prog[n.b];
+		//A constant divisor other than 0 and -1 needs no check
+		if (r.kind == N_CONST && prog.consts[r.a].GetInt() != 0 && prog.consts[r.a].GetInt() != -1)
+		{
+			int k = prog.consts[r.a].GetInt();
+			if (n.kind == N_MOD)
+				return WithConstant(std::move(left), k, modulus<int>());
+			return WithConstant(std::move(left), k, divides<int>());
+		}
+		IntCode right = Int(n.b);
+		int line = n.line;
+		bool mod = n.kind == N_MOD;
+		return [left = std::move(left), right = std::move(right), line, mod](ClosureFrame& f) {
+			int v1 = left(f);
+			int v2 = right(f);
+			if (v2 == 0)
+			{
+				Fail(f.ctx, line, "Illegal division by zero");
+			}
+			if (v2 == -1 && v1 == INT_MIN)
+			{
+				Fail(f.ctx, line, "Integer division overflow");
+			}
+			return mod ? v1 % v2 : v1 / v2;
+		};
+	}
+	default:
+		return [](ClosureFrame&) { return 0; };
+	}
+}
+
+RealCode ClosureCompiler::Real(NodeId id)
+{
+	const Node& n = prog[id];
+	closures++;
+	if (LongChain(prog, id))
+	{
+		return Fold(Chain(id), &Number::r);
+	}
+	switch (n.kind)
+	{
+	case N_CONST:
+	{
+		double k = prog.consts[n.a].GetReal();
+		return [k](ClosureFrame&) { return k; };
+	}
+	case N_VAR:
+	{
+		uint32_t slot = n.a;
+		int line = n.line;
+		return [slot, line](ClosureFrame& f) { return Load(f, slot, VREAL, line).GetReal(); };
+	}
+	case N_NEG:
+	{
+		RealCode e = Real(n.a);
+		return [e = std::move(e)](ClosureFrame& f) { return -e(f); };
+	}
+	case N_ADD:
+	case N_SUB:
+	case N_MUL:
+	{
+		RealCode left = Widened(n.a);
+		const Node& r = prog[n.b];
+		if (r.kind == N_CONST)
+		{
+			const Value& c = prog.consts[r.a];
+			double k = r.type == VINT ? (float)c.GetInt() : c.GetReal();
+			switch (n.kind)
+			{
+			case N_ADD:	return WithConstant(std::move(left), k, plus<double>());
+			case N_SUB:	return WithConstant(std::move(left), k, minus<double>());
+			default:	return WithConstant(std::move(left), k, multiplies<double>());
+			}
+		}
+		RealCode right = Widened(n.b);
+		switch (n.kind)
+		{
+		case N_ADD:	return Binary(std::move(left), std::move(right), plus<double>());
+		case N_SUB:	return Binary(std::move(left), std::move(right), minus<double>());
+		default:	return Binary(std::move(left), std::move(right), multiplies<double>());
+		}
+	}
+	case N_DIV:
+	case N_IDIV:
+	{
+		IntCode left = Dividend(n.a);
+		RealCode right = Real(n.b);
+		int line = n.line;
+		return [left = std::move(left), right = std::move(right), line](ClosureFrame& f) {
+			int v1 = left(f);
+			double v2 = right(f);
+			if (v2 == 0)
+			{
+				Fail(f.ctx, line, "Illegal division by zero");
+			}
+			return v1 / v2;
+		};
+	}
+	default:
+		return [](ClosureFrame&) { return 0.0; };
+	}
+}
+
+BoolCode ClosureCompiler::Bool(NodeId id)
+{
+	const Node& n = prog[id];
+	closures++;
+	switch (n.kind)
+	{
+	case N_CONST:
+	{
+		bool k = prog.consts[n.a].GetBool();
+		return [k](ClosureFrame&) { return k; };
+	}
+	case N_VAR:
+	{
+		uint32_t slot = n.a;
+		int line = n.line;
+		return [slot, line](ClosureFrame& f) { return Load(f, slot, VBOOL, line).GetBool(); };
+	}
+	case N_NOT:
+	{
+		BoolCode e = Bool(n.a);
+		return [e = std::move(e)](ClosureFrame& f) { return !e(f); };
+	}
+
+	case N_EQ:
+	{
+		ValType t1 = prog[n.a].type, t2 = prog[n.b].type;
+		if (t1 != t2)
+			return Binary(Widened(n.a), Widened(n.b), equal_to<double>());
+		switch (t1)
+		{
+		case VINT:	return Binary(Int(n.a), Int(n.b), equal_to<int>());
+		case VREAL:	return Binary(Real(n.a), Real(n.b), equal_to<double>());
+		case VBOOL:	return Binary(Bool(n.a), Bool(n.b), equal_to<bool>());
+		default:
+			return Binary(String(n.a), String(n.b), [](const Value& v1, const Value& v2) {
+				return v1.GetString() == v2.GetString();
+			});
+		}
+	}
+
+	case N_LTHAN:
+	case N_GTHAN:
+	{
+		bool less = n.kind == N_LTHAN;
+		if (prog[n.a].type == VINT && prog[n.b].type == VINT)
+		{
+			IntCode left = Int(n.a);
+			const Node& r = prog[n.b];
+			if (r.kind == N_CONST)
+			{
+				int k = prog.consts[r.a].GetInt();
+				if (less)
+					return WithConstant(std::move(left), k, std::less<int>());
+				return WithConstant(std::move(left), k, greater<int>());
+			}
+			IntCode right = Int(n.b);
+			if (less)
+				return Binary(std::move(left), std::move(right), std::less<int>());
+			return Binary(std::move(left), std::move(right), greater<int>());
+		}
+		RealCode left = AsReal(n.a), right = AsReal(n.b);
+		if (less)
+			return Binary(std::move(left), std::move(right), std::less<double>());
+		return Binary(std::move(left), std::move(right), greater<double>());
+	}
+
+	case N_AND:
+	case N_OR:
+	{
+		//A chain of them is walked down its left operands and run as one
+		//loop, which skips each right operand the value so far decides
+		vector<NodeId> spine;
+		NodeId leaf = id;
+		while (prog[leaf].kind == N_AND || prog[leaf].kind == N_OR)
+		{
+			spine.push_back(leaf);
+			leaf = prog[leaf].a;
+		}
+		BoolCode left = Bool(leaf);
+		if (spine.size() == 1)
+		{
+			BoolCode right = Bool(n.b);
+			if (n.kind == N_AND)
+				return [left = std::move(left), right = std::move(right)](ClosureFrame& f) { return left(f) && right(f); };
+			return [left = std::move(left), right = std::move(right)](ClosureFrame& f) { return left(f) || right(f); };
+		}
+		//Each right operand, and the value so far that makes it run
+		vector<pair<bool, BoolCode>> rights;
+		for (size_t k = spine.size(); k-- > 0;)
+		{
+			closures++;
+			const Node& op = prog[spine[k]];
+			rights.emplace_back(op.kind == N_AND, Bool(op.b));
+		}
+		return [left = std::move(left), rights = std::move(rights)](ClosureFrame& f) {
+			bool v = left(f);
+			for (const auto& right : rights)
+			{
+				if (v == right.first)
+				{
+					v = right.second(f);
+				}
+			}
+			return v;
+		};
+	}
+	default:
+		return [](ClosureFrame&) { return false; };
+	}
+}
+
+StringCode ClosureCompiler::String(NodeId id)
+{
+	const Node& n = prog[id];
+	closures++;
+	if (n.kind == N_VAR)
+	{
+		uint32_t slot = n.a;
+		int line = n.line;
+		return [slot, line](ClosureFrame& f) { return Load(f, slot, VSTRING, line); };
+	}
+	Value k = n.kind == N_CONST ? prog.consts[n.a] : Value();
+	return [k](ClosureFrame&) { return k; };
+}
+
+//An integer operand of a mixed +, -, * or = goes through float, as in
+//Value's operators
+RealCode ClosureCompiler::Widened(NodeId id)
+{
+	if (prog[id].type != VINT)
+	{
+		return Real(id);
+	}
+	closures++;
+	IntCode e = Int(id);
+	return [e = std::move(e)](ClosureFrame& f) { return (double)(float)e(f); };
+}
+
+RealCode ClosureCompiler::AsReal(NodeId id)
+{
+	if (prog[id].type != VINT)
+	{
+		return Real(id);
+	}
+	closures++;
+	IntCode e = Int(id);
+	return [e = std::move(e)](ClosureFrame& f) { return (double)e(f); };
+}
+
+//The dividend of DIV and IDIV, truncated
+IntCode ClosureCompiler::Dividend(NodeId id)
+{
+	if (prog[id].type == VINT)
+	{
+		return Int(id);
+	}
+	closures++;
+	RealCode e = Real(id);
+	return [e = std::move(e)](ClosureFrame& f) { return (int)e(f); };
+}
+
+//The steps of the left-deep chain of arithmetic operators ending at id: its
+//leftmost operand, then each operator in the order it applies. The value
+//so far is converted where the next operator takes the other type, as
+//Widened and Dividend convert an operand
+vector<StepCode> ClosureCompiler::Chain(NodeId id)
+{
+	vector<NodeId> spine;
+	NodeId leaf = id;
+	while (Arithmetic(prog[leaf]))
+	{
+		spine.push_back(leaf);
+		leaf = prog[leaf].a;
+	}
+	vector<StepCode> steps;
+	ValType t = prog[leaf].type;
+	if (t == VINT)
+	{
+		IntCode e = Int(leaf);
+		steps.push_back([e = std::move(e)](ClosureFrame& f, Number& v) { v.i = e(f); });
+	}
+	else
+	{
+		RealCode e = Real(leaf);
+		steps.push_back([e = std::move(e)](ClosureFrame& f, Number& v) { v.r = e(f); });
+	}
+	for (size_t k = spine.size(); k-- > 0;)
+	{
+		const Node& n = prog[spine[k]];
+		bool division = n.kind == N_DIV || n.kind == N_IDIV || n.kind == N_MOD;
+		if (division && t == VREAL)
+		{
+			closures++;
+			steps.push_back([](ClosureFrame&, Number& v) { v.i = (int)v.r; });
+		}
+		else if (!division && n.type == VREAL && t == VINT)
+		{
+			closures++;
+			steps.push_back([](ClosureFrame&, Number& v) { v.r = (float)v.i; });
+		}
+		closures++;
+		steps.push_back(Operator(n));
+		t = n.type;
+	}
+	return steps;
+}
+
+//Arithmetic operator n as a step of a chain, whose value so far already has
+//the type of n's left operand, or is the truncated dividend of DIV and IDIV
+StepCode ClosureCompiler::Operator(const Node& n)
+{
+	const Node& r = prog[n.b];
+	int line = n.line;
+	if (n.kind == N_DIV || n.kind == N_IDIV || n.kind == N_MOD)
+	{
+		if (n.type == VREAL)
+		{
+			RealCode right = Real(n.b);
+			return [right = std::move(right), line](ClosureFrame& f, Number& v) {
+				double v2 = right(f);
+				if (v2 == 0)
+				{
+					Fail(f.ctx, line, "Illegal division by zero");
+				}
+				v.r = v.i / v2;
+			};
+		}
+		//A constant divisor other than 0 and -1 needs no check
+		if (r.kind == N_CONST && prog.consts[r.a].GetInt() != 0 && prog.consts[r.a].GetInt() != -1)
+		{
+			int k = prog.consts[r.a].GetInt();
+			if (n.kind == N_MOD)
+				return StepConstant(&Number::i, k, modulus<int>());
+			return StepConstant(&Number::i, k, divides<int>());
+		}
+		IntCode right = Int(n.b);
+		bool mod = n.kind == N_MOD;
+		return [right = std::move(right), line, mod](ClosureFrame& f, Number& v) {
+			int v2 = right(f);
+			if (v2 == 0)
+			{
+				Fail(f.ctx, line, "Illegal division by zero");
+			}
+			if (v2 == -1 && v.i == INT_MIN)
+			{
+				Fail(f.ctx, line, "Integer division overflow");
+			}
+			v.i = mod ? v.i % v2 : v.i / v2;
+		};
+	}
+	if (n.type == VREAL)
+	{
+		if (r.kind == N_CONST)
+		{
+			const Value& c = prog.consts[r.a];
+			double k = r.type == VINT ? (float)c.GetInt() : c.GetReal();
+			switch (n.kind)
+			{
+			case N_ADD:	return StepConstant(&Number::r, k, plus<double>());
+			case N_SUB:	return StepConstant(&Number::r, k, minus<double>());
+			default:	return StepConstant(&Number::r, k, multiplies<double>());
+			}
+		}
+		RealCode right = Widened(n.b);
+		switch (n.kind)
+		{
+		case N_ADD:	return Step(&Number::r, std::move(right), plus<double>());
+		case N_SUB:	return Step(&Number::r, std::move(right), minus<double>());
+		default:	return Step(&Number::r, std::move(right), multiplies<double>());
+		}
+	}
+	if (r.kind == N_CONST)
+	{
+		int k = prog.consts[r.a].GetInt();
+		switch (n.kind)
+		{
+		case N_ADD:	return StepConstant(&Number::i, k, plus<int>());
+		case N_SUB:	return StepConstant(&Number::i, k, minus<int>());
+		default:	return StepConstant(&Number::i, k, multiplies<int>());
+		}
+	}
+	IntCode right = Int(n.b);
+	switch (n.kind)
+	{
+	case N_ADD:	return Step(&Number::i, std::move(right), plus<int>());
+	case N_SUB:	return Step(&Number::i, std::move(right), minus<int>());
+	default:	return Step(&Number::i, std::move(right), multiplies<int>());
+	}
+}
+
+//Assigns expression expr to slots, variables of type n.type
+StmtCode ClosureCompiler::Store(const Node& n, NodeId expr, const vector<uint32_t>& slots)
+{
+	switch (n.type)
+	{
+	case VINT:	return Assign(slots, Int(expr));
+	case VREAL:	return Assign(slots, AsReal(expr));
+	case VBOOL:	return Assign(slots, Bool(expr));
+	default:	return Assign(slots, String(expr));
+	}
+}
+
+StmtCode ClosureCompiler::Stmt(NodeId id)
+{
+	const Node& n = prog[id];
+	closures++;
+	switch (n.kind)
+	{
+	case N_ASSIGN:
+		return Store(n, n.b, {n.a});
+	case N_INIT:
+	{
+		const uint32_t* slots = prog.List(n);
+		return Store(n, n.c, vector<uint32_t>(slots, slots + n.b));
+	}
+
+	case N_WRITE:
+	case N_WRITELN:
+	{
+		vector<StmtCode> writes;
+		const uint32_t* exprs = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			closures++;
+			switch (prog[exprs[k]].type)
+			{
+			case VINT:	writes.push_back(Write(Int(exprs[k])));	break;
+			case VREAL:	writes.push_back(Write(Real(exprs[k])));	break;
+			case VBOOL:	writes.push_back(Write(Bool(exprs[k])));	break;
+			default:	writes.push_back(Write(String(exprs[k])));	break;
+			}
+		}
+		bool line = n.kind == N_WRITELN;
+		return [writes = std::move(writes), line](ClosureFrame& f) {
+			for (const StmtCode& write : writes)
+			{
+				write(f);
+			}
+			if (line)
+			{
+				f.ctx.out << "\n";
+			}
+		};
+	}
+
+	case N_IF:
+	{
+		BoolCode cond = Bool(n.a);
+		StmtCode then = Stmt(n.b);
+		if (n.c == NONODE)
+		{
+			return [cond = std::move(cond), then = std::move(then)](ClosureFrame& f) {
+				if (cond(f))
+					then(f);
+			};
+		}
+		StmtCode otherwise = Stmt(n.c);
+		return [cond = std::move(cond), then = std::move(then), otherwise = std::move(otherwise)](ClosureFrame& f) {
+			if (cond(f))
+				then(f);
+			else
+				otherwise(f);
+		};
+	}
+
+	case N_BLOCK:
+	{
+		vector<StmtCode> stmts;
+		const uint32_t* list = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			stmts.push_back(Stmt(list[k]));
+		}
+		return [stmts = std::move(stmts)](ClosureFrame& f) {
+			for (const StmtCode& stmt : stmts)
+			{
+				stmt(f);
+			}
+		};
+	}
+
+	default:
+		return [](ClosureFrame&) {};
+	}
+}
+
+}
+
+// Compiles program into closures
+void CompileClosures(const Program& program, ClosureProgram& compiled)
+{
+	ClosureCompiler c{program};
+	compiled = ClosureProgram();
+	compiled.vars = program.vars.size();
+	for (NodeId init : program.inits)
+	{
+		compiled.stmts.push_back(c.Stmt(init));
+	}
+	if (program.body != NONODE)
+	{
+		compiled.stmts.push_back(c.Stmt(program.body));
+	}
+	compiled.closures = c.closures;
+}
+
+// Runs compiled, as Execute would run the program it was compiled from
+bool ExecuteClosures(Interpreter& ctx, const ClosureProgram& compiled)
+{
+	ctx.TempsResults.assign(compiled.vars, Value());
+	ClosureFrame f{ctx, ctx.TempsResults.data()};
+	try
+	{
+		for (const StmtCode& stmt : compiled.stmts)
+		{
+			stmt(f);
+		}
+	}
+	catch (RuntimeError&)
+	{
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,36 @@
+#ifndef CLOSURE_H_
+#define CLOSURE_H_
+
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+#include "val.h"
+
+struct Interpreter;
+
+//What compiled code runs against: the context it writes and reports errors
+//to, and the variables by slot
+struct ClosureFrame {
+	Interpreter&	ctx;
+	Value*	vars;
+};
+
+//A compiled expression of each static type, and a compiled statement
+typedef function<int(ClosureFrame&)>	IntCode;
+typedef function<double(ClosureFrame&)>	RealCode;
+typedef function<bool(ClosureFrame&)>	BoolCode;
+typedef function<Value(ClosureFrame&)>	StringCode;
+typedef function<void(ClosureFrame&)>	StmtCode;
+
+//A program compiled by closure.cpp into a tree of callables, about one per
+//node, each specialized on the static types of its operands
+struct ClosureProgram {
+	vector<StmtCode>	stmts;		//the declarations' initializers, then the body
+	uint32_t	vars = 0;
+	uint32_t	closures = 0;	//callables made
+};
+
+#endif /* CLOSURE_H_ */
@@ -0,0 +1,438 @@
+/*
+Description: Compiles a typed program tree into bytecode for the stack
+	machine of vm.cpp. Every operation is chosen from the static types of
+	its operands, with explicit conversions where Value's operators would
+	convert, so the machine never looks at a type; an if statement becomes a
+	conditional jump over its then branch and a jump over its else branch.
+	An operator whose right operand is a constant or a variable is fused
+	with the instruction pushing it into one superinstruction.
+*/
+
+#include "parserInterp.h"
+
+namespace {
+
+//One step of compiling an expression: the whole subtree at node, or when
+//node is NONODE, a single instruction
+struct Task {
+	NodeId	node;
+	OpCode	op;
+	int	line;
+};
+
+struct Compiler {
+	const Program&	prog;
+	Chunk&	chunk;
+	uint32_t	depth = 0;	//stack depth after the code emitted so far
+	uint32_t	target = 0;	//the last jump target; no instruction before it is fused
+	bool	fuse;		//whether to make superinstructions
+	vector<Task>	work;		//Expr's pending steps, kept for the next expression
+	vector<uint32_t>	joins;	//short-circuit jumps waiting for the end of their right operand
+
+	Compiler(const Program& prog, Chunk& chunk, bool fuse) : prog(prog), chunk(chunk), fuse(fuse) {}
+
+	void Emit(OpCode op, int line, uint32_t a = 0);
+	bool Fuse(OpCode op);
+	void Patch(uint32_t jump);
+	void Constant(const Node& n);
+	void Expr(NodeId id);
+	void Stmt(NodeId id);
+	uint32_t Here() const { return chunk.code.size(); }
+};
+
+//Change in stack depth made by op
+int StackEffect(OpCode op)
+{
+	switch (op)
+	{
+	case OP_PUSH: case OP_PUSH_S:
+	case OP_LOAD_I: case OP_LOAD_R: case OP_LOAD_B: case OP_LOAD_S:
+	case OP_DUP:
+		return 1;
+	case OP_I2R: case OP_I2F: case OP_R2I:
+	case OP_NEG_I: case OP_NEG_R: case OP_NOT:
+	case OP_ADD_IC: case OP_SUB_IC: case OP_MUL_IC: case OP_DIV_IC: case OP_MOD_IC:
+	case OP_EQ_IC: case OP_LT_IC: case OP_GT_IC:
+	case OP_ADD_RC: case OP_SUB_RC: case OP_MUL_RC: case OP_EQ_RC: case OP_LT_RC: case OP_GT_RC:
+	case OP_ADD_IV: case OP_SUB_IV: case OP_MUL_IV: case OP_EQ_IV: case OP_LT_IV: case OP_GT_IV:
+	case OP_ADD_RV: case OP_SUB_RV: case OP_MUL_RV: case OP_EQ_RV: case OP_LT_RV: case OP_GT_RV:
+	case OP_JUMP: case OP_WRITELN: case OP_HALT:
+		return 0;
+	default:
+		//Stores, writes, conditional jumps and binary operators
+		return -1;
+	}
+}
+
+//No instruction, for operands that need no conversion and operators that
+//have no superinstruction
+const OpCode NOOP = OP_COUNT;
+
+//Not an instruction: points the innermost short-circuit jump here
+const OpCode JOIN = OpCode(OP_COUNT + 1);
+
+//The superinstruction for op with constant c as its right operand. A
+//division by a constant zero, or by -1, which overflows on INT_MIN, is
+//left to the checks of the plain instruction
+OpCode WithConstant(OpCode op, Cell c)
+{
+	switch (op)
+	{
+	case OP_ADD_I:	return OP_ADD_IC;
+	case OP_SUB_I:	return OP_SUB_IC;
+	case OP_MUL_I:	return OP_MUL_IC;
+	case OP_DIV_I:	return c.i != 0 && c.i != -1 ? OP_DIV_IC : NOOP;
+	case OP_MOD_I:	return c.i != 0 && c.i != -1 ? OP_MOD_IC : NOOP;
+	case OP_EQ_I:	return OP_EQ_IC;
+	case OP_LT_I:	return OP_LT_IC;
+	case OP_GT_I:	return OP_GT_IC;
+	case OP_ADD_R:	return OP_ADD_RC;
+	case OP_SUB_R:	return OP_SUB_RC;
+	case OP_MUL_R:	return OP_MUL_RC;
+	case OP_EQ_R:	return OP_EQ_RC;
+	case OP_LT_R:	return OP_LT_RC;
+	case OP_GT_R:	return OP_GT_RC;
+	default:	return NOOP;
+	}
+}
+
+//The superinstruction for op with a variable its load instruction pushed
+//as its right operand. Division is not fused, so that a division by zero
+//is still reported at the operator's line
+OpCode WithVariable(OpCode op, OpCode load)
+{
+	switch (load == OP_LOAD_I ? op : NOOP)
+	{
+	case OP_ADD_I:	return OP_ADD_IV;
+	case OP_SUB_I:	return OP_SUB_IV;
+	case OP_MUL_I:	return OP_MUL_IV;
+	case OP_EQ_I:	return OP_EQ_IV;
+	case OP_LT_I:	return OP_LT_IV;
+	case OP_GT_I:	return OP_GT_IV;
+	default:	break;
+	}
+	switch (load == OP_LOAD_R ? op : NOOP)
+	{
+	case OP_ADD_R:	return OP_ADD_RV;
+	case OP_SUB_R:	return OP_SUB_RV;
+	case OP_MUL_R:	return OP_MUL_RV;
+	case OP_EQ_R:	return OP_EQ_RV;
+	case OP_LT_R:	return OP_LT_RV;
+	case OP_GT_R:	return OP_GT_RV;
+	default:	return NOOP;
+	}
+}
+
+void Compiler::Emit(OpCode op, int line, uint32_t a)
+{
+	depth += StackEffect(op);
+	chunk.maxStack = max(chunk.maxStack, depth);
+	if (Fuse(op))
+	{
+		return;
+	}
+	if (chunk.lines.empty() || chunk.lines.back().line != line)
+	{
+		chunk.lines.push_back({Here(), line});
+	}
+	chunk.code.push_back({op, a});
+}
+
+//Folds binary operator op into the instruction pushing its right operand,
+//when there is a superinstruction for the pair. The fused instruction
+//keeps the line of the operand, the only part of it that can fail
+bool Compiler::Fuse(OpCode op)
+{
+	if (!fuse || Here() <= target)
+	{
+		return false;
+	}
+	Instr& last = chunk.code.back();
+	OpCode fused = NOOP;
+	if (last.op == OP_PUSH)
+		fused = WithConstant(op, chunk.consts[last.a]);
+	else if (last.op == OP_LOAD_I || last.op == OP_LOAD_R)
+		fused = WithVariable(op, last.op);
+	if (fused == NOOP)
+	{
+		return false;
+	}
+	last.op = fused;
+	chunk.fused++;
+	return true;
+}
+
+//Points the jump at pc jump to the next instruction
+void Compiler::Patch(uint32_t jump)
+{
+	target = Here();
+	chunk.code[jump].a = target;
+}
+
+void Compiler::Constant(const Node& n)
+{
+	const Value& v = prog.consts[n.a];
+	if (v.IsString())
+	{
+		chunk.strings.push_back(v);
+		Emit(OP_PUSH_S, n.line, chunk.strings.size() - 1);
+		return;
+	}
+	Cell c;
+	switch (v.GetType())
+	{
+	case VINT:	c.i = v.GetInt();	break;
+	case VREAL:	c.r = v.GetReal();	break;
+	default:	c.b = v.GetBool();	break;
+	}
+	chunk.consts.push_back(c);
+	Emit(OP_PUSH, n.line, chunk.consts.size() - 1);
+}
+
+//Opcode for each type of value, in ValType order
+OpCode Typed(ValType t, OpCode i, OpCode r, OpCode s, OpCode b)
+{
+	switch (t)
+	{
+	case VINT:	return i;
+	case VREAL:	return r;
+	case VSTRING:	return s;
+	default:	return b;
+	}
+}
+
+//Compiles expression id, leaving its value on the stack. The work list
+//stands in for recursion, so a long chain of operators compiles in
+//constant native stack
+void Compiler::Expr(NodeId id)
+{
+	work.push_back({id, NOOP, 0});
+	while (!work.empty())
+	{
+		Task t = work.back();
+		work.pop_back();
+		if (t.node == NONODE)
+		{
+			if (t.op == JOIN)
+			{
+				Patch(joins.back());
+				joins.pop_back();
+				continue;
+			}
+			if (t.op == OP_AND_JUMP || t.op == OP_OR_JUMP)
+			{
+				joins.push_back(Here());
+			}
+			Emit(t.op, t.line);
+			continue;
+		}
+
+		const Node& n = prog[t.node];
+		ValType l = VERR, r = VERR;
+		if (n.kind >= N_ADD && n.kind <= N_OR)
+		{
+			l = prog[n.a].type;
+			r = prog[n.b].type;
+		}
+		//Pushed in reverse: left operand, its conversion, right operand,
+		//its conversion, operator
+		auto then = [&](OpCode op) { work.push_back({NONODE, op, n.line}); };
+		auto operands = [&](OpCode convl, OpCode convr) {
+			if (convr != NOOP)
+				then(convr);
+			work.push_back({n.b, NOOP, 0});
+			if (convl != NOOP)
+				then(convl);
+			work.push_back({n.a, NOOP, 0});
+		};
+		//The conversion an operand of type t needs to become a real
+		auto widen = [](ValType t, OpCode conv) { return t == VINT ? conv : NOOP; };
+
+		switch (n.kind)
+		{
+		case N_CONST:
+			Constant(n);
+			break;
+		case N_VAR:
+			Emit(Typed(n.type, OP_LOAD_I, OP_LOAD_R, OP_LOAD_S, OP_LOAD_B), n.line, n.a);
+			break;
+		case N_NEG:
+		case N_NOT:
+			then(n.kind == N_NOT ? OP_NOT : n.type == VINT ? OP_NEG_I : OP_NEG_R);
+			work.push_back({n.a, NOOP, 0});
+			break;
+
+		case N_ADD:
+		case N_SUB:
+		case N_MUL:
+		{
+			static const OpCode ints[] = {OP_ADD_I, OP_SUB_I, OP_MUL_I}, reals[] = {OP_ADD_R, OP_SUB_R, OP_MUL_R};
+			int k = n.kind - N_ADD;
+			if (n.type == VINT)
+			{
+				then(ints[k]);
+				operands(NOOP, NOOP);
+			}
+			else
+			{
+				then(reals[k]);
+				operands(widen(l, OP_I2F), widen(r, OP_I2F));
+			}
+			break;
+		}
+		case N_DIV:
+		case N_IDIV:
+			//The dividend is truncated; the divisor's type is the result's
+			then(r == VINT ? OP_DIV_I : OP_DIV_IR);
+			operands(l == VREAL ? OP_R2I : NOOP, NOOP);
+			break;
+		case N_MOD:
+			then(OP_MOD_I);
+			operands(NOOP, NOOP);
+			break;
+
+		case N_EQ:
+			if (l != r)
+			{
+				then(OP_EQ_R);
+				operands(widen(l, OP_I2F), widen(r, OP_I2F));
+			}
+			else
+			{
+				then(Typed(l, OP_EQ_I, OP_EQ_R, OP_EQ_S, OP_EQ_B));
+				operands(NOOP, NOOP);
+			}
+			break;
+		case N_LTHAN:
+		case N_GTHAN:
+			if (l == VINT && r == VINT)
+			{
+				then(n.kind == N_LTHAN ? OP_LT_I : OP_GT_I);
+				operands(NOOP, NOOP);
+			}
+			else
+			{
+				then(n.kind == N_LTHAN ? OP_LT_R : OP_GT_R);
+				operands(widen(l, OP_I2R), widen(r, OP_I2R));
+			}
+			break;
+		case N_AND:
+		case N_OR:
+			//A left operand that decides the result stays on the stack as
+			//it, jumping over the right operand; otherwise it is popped
+			then(JOIN);
+			work.push_back({n.b, NOOP, 0});
+			then(n.kind == N_AND ? OP_AND_JUMP : OP_OR_JUMP);
+			work.push_back({n.a, NOOP, 0});
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void Compiler::Stmt(NodeId id)
+{
+	const Node& n = prog[id];
+	switch (n.kind)
+	{
+	case N_ASSIGN:
+	case N_INIT:
+	{
+		NodeId expr = n.kind == N_ASSIGN ? n.b : n.c;
+		Expr(expr);
+		if (n.type == VREAL && prog[expr].type == VINT)
+		{
+			Emit(OP_I2R, n.line);
+		}
+		OpCode store = Typed(n.type, OP_STORE_I, OP_STORE_R, OP_STORE_S, OP_STORE_B);
+		if (n.kind == N_ASSIGN)
+		{
+			Emit(store, n.line, n.a);
+			break;
+		}
+		const uint32_t* slots = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			if (k + 1 < n.b)
+			{
+				Emit(OP_DUP, n.line);
+			}
+			Emit(store, n.line, slots[k]);
+		}
+		break;
+	}
+
+	case N_WRITE:
+	case N_WRITELN:
+	{
+		const uint32_t* exprs = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			Expr(exprs[k]);
+			Emit(Typed(prog[exprs[k]].type, OP_WRITE_I, OP_WRITE_R, OP_WRITE_S, OP_WRITE_B), n.line);
+		}
+		if (n.kind == N_WRITELN)
+		{
+			Emit(OP_WRITELN, n.line);
+		}
+		break;
+	}
+
+	case N_IF:
+	{
+		Expr(n.a);
+		uint32_t skipThen = Here();
+		Emit(OP_JUMP_FALSE, n.line);
+		Stmt(n.b);
+		if (n.c != NONODE)
+		{
+			uint32_t skipElse = Here();
+			Emit(OP_JUMP, n.line);
+			Patch(skipThen);
+			Stmt(n.c);
+			Patch(skipElse);
+		}
+		else
+		{
+			Patch(skipThen);
+		}
+		break;
+	}
+
+	case N_BLOCK:
+	{
+		const uint32_t* stmts = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			Stmt(stmts[k]);
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+}
+
+// Compiles program, which must have passed TypeCheck, into chunk: the
+// declarations in order, then the main compound statement
+void Compile(const Program& program, Chunk& chunk, bool fuse)
+{
+	chunk = Chunk();
+	chunk.vars = program.vars.size();
+	//Most nodes become one instruction
+	chunk.code.reserve(program.nodes.size() + program.lists.size());
+	Compiler c(program, chunk, fuse);
+	for (NodeId init : program.inits)
+	{
+		c.Stmt(init);
+	}
+	if (program.body != NONODE)
+	{
+		c.Stmt(program.body);
+	}
+	c.Emit(OP_HALT, 0);
+}
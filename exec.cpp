@@ -0,0 +1,493 @@
+/*
+Description: Executes a program tree built and typed by ParseProg,
+	either by walking the tree here, on the stack machine of vm.cpp, the
+	register machine of regvm.cpp, as machine code from jit.cpp or as the
+	closures of closure.cpp.
+	Declarations are initialized in order, then the main compound statement
+	is run. Type errors were all reported before; the first runtime error,
+	an uninitialized variable, a division by zero or INT_MIN divided by
+	-1, is reported through ParseError and stops execution. Also the
+	interpreter's entry points, which parse and then execute.
+*/
+
+#include "parserInterp.h"
+#include <climits>
+
+namespace {
+
+//Thrown out of the evaluator once a runtime error has been reported
+struct RuntimeError {};
+
+[[noreturn]] void Fail(Interpreter& ctx, int line, const char* msg)
+{
+	ParseError(ctx, line, msg);
+	throw RuntimeError();
+}
+
+//Variables live in TempsResults by slot; a slot's bit in assigned is set
+//by its first assignment
+const Value& Load(Interpreter& ctx, const Node& n)
+{
+	if (!(ctx.assigned[n.a >> 6] >> (n.a & 63) & 1))
+	{
+		Fail(ctx, n.line, "Using uninitialzied variable");
+	}
+	return ctx.TempsResults[n.a];
+}
+
+void Store(Interpreter& ctx, uint32_t slot, Value v)
+{
+	ctx.TempsResults[slot] = std::move(v);
+	ctx.assigned[slot >> 6] |= uint64_t(1) << (slot & 63);
+}
+
+//Each of these evaluates an expression TypeCheck gave that type, so the
+//operand types of every operator are known without looking at any Value
+int EvalInt(Interpreter& ctx, const Program& prog, NodeId id);
+double EvalReal(Interpreter& ctx, const Program& prog, NodeId id);
+bool EvalBool(Interpreter& ctx, const Program& prog, NodeId id);
+Value Eval(Interpreter& ctx, const Program& prog, NodeId id);
+
+//An integer operand of a mixed +, -, * or = goes through float, as in
+//Value's operators
+double Widened(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	return prog[id].type == VINT ? (float)EvalInt(ctx, prog, id) : EvalReal(ctx, prog, id);
+}
+
+double AsReal(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	return prog[id].type == VINT ? EvalInt(ctx, prog, id) : EvalReal(ctx, prog, id);
+}
+
+//The result of an arithmetic node, in i or in r as its type says
+struct Number {
+	int	i = 0;
+	double	r = 0;
+};
+
+//The operators down the left spine of a chain, outermost first; ordinary
+//expressions need no allocation
+struct Spine {
+	static const size_t	LOCAL = 16;
+	NodeId	local[LOCAL];
+	vector<NodeId>	more;
+	size_t	size = 0;
+
+	void Push(NodeId id)
+	{
+		if (size < LOCAL)
+			local[size] = id;
+		else
+			more.push_back(id);
+		size++;
+	}
+
+	NodeId operator[](size_t k) const
+	{
+		return k < LOCAL ? local[k] : more[k - LOCAL];
+	}
+};
+
+bool Arithmetic(const Node& n)
+{
+	return n.kind >= N_ADD && n.kind <= N_MOD;
+}
+
+//Applies arithmetic node n to its left operand v, of type t, and its right
+//operand, converting v as Widened would
+Number Apply(Interpreter& ctx, const Program& prog, const Node& n, ValType t, Number v)
+{
+	Number result;
+	if (n.kind == N_DIV || n.kind == N_IDIV || n.kind == N_MOD)
+	{
+		//The dividend of DIV and IDIV, truncated
+		int v1 = t == VINT ? v.i : (int)v.r;
+		if (n.type == VREAL)
+		{
+			double v2 = EvalReal(ctx, prog, n.b);
+			if (v2 == 0)
+			{
+				Fail(ctx, n.line, "Illegal division by zero");
+			}
+			result.r = v1 / v2;
+			return result;
+		}
+		int v2 = EvalInt(ctx, prog, n.b);
+		if (v2 == 0)
+		{
+			Fail(ctx, n.line, "Illegal division by zero");
+		}
+		if (v2 == -1 && v1 == INT_MIN)
+		{
+			Fail(ctx, n.line, "Integer division overflow");
+		}
+		result.i = n.kind == N_MOD ? v1 % v2 : v1 / v2;
+		return result;
+	}
+	if (n.type == VINT)
+	{
+		int v2 = EvalInt(ctx, prog, n.b);
+		result.i = n.kind == N_ADD ? v.i + v2 : n.kind == N_SUB ? v.i - v2 : v.i * v2;
+		return result;
+	}
+	double v1 = t == VINT ? (float)v.i : v.r;
+	double v2 = Widened(ctx, prog, n.b);
+	result.r = n.kind == N_ADD ? v1 + v2 : n.kind == N_SUB ? v1 - v2 : v1 * v2;
+	return result;
+}
+
+//Evaluates arithmetic node id. A left-deep chain such as a + b - c * d is
+//walked down its left operands first and then folded back up in a loop, so
+//a long one takes no native stack per operator
+Number EvalArithmetic(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	Spine spine;
+	NodeId leaf = prog[id].a;
+	while (Arithmetic(prog[leaf]))
+	{
+		spine.Push(leaf);
+		leaf = prog[leaf].a;
+	}
+	ValType t = prog[leaf].type;
+	Number v;
+	if (t == VINT)
+		v.i = EvalInt(ctx, prog, leaf);
+	else
+		v.r = EvalReal(ctx, prog, leaf);
+	for (size_t k = spine.size; k-- > 0;)
+	{
+		const Node& n = prog[spine[k]];
+		v = Apply(ctx, prog, n, t, v);
+		t = n.type;
+	}
+	return Apply(ctx, prog, prog[id], t, v);
+}
+
+int EvalInt(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	const Node& n = prog[id];
+	switch (n.kind)
+	{
+	case N_CONST:
+		return prog.consts[n.a].GetInt();
+	case N_VAR:
+		return Load(ctx, n).GetInt();
+	case N_NEG:
+		return -EvalInt(ctx, prog, n.a);
+	case N_ADD:
+	case N_SUB:
+	case N_MUL:
+	case N_DIV:
+	case N_IDIV:
+	case N_MOD:
+		return EvalArithmetic(ctx, prog, id).i;
+	default:
+		return 0;
+	}
+}
+
+double EvalReal(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	const Node& n = prog[id];
+	switch (n.kind)
+	{
+	case N_CONST:
+		return prog.consts[n.a].GetReal();
+	case N_VAR:
+		return Load(ctx, n).GetReal();
+	case N_NEG:
+		return -EvalReal(ctx, prog, n.a);
+	case N_ADD:
+	case N_SUB:
+	case N_MUL:
+	case N_DIV:
+	case N_IDIV:
+		return EvalArithmetic(ctx, prog, id).r;
+	default:
+		return 0;
+	}
+}
+
+bool EvalBool(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	const Node& n = prog[id];
+	switch (n.kind)
+	{
+	case N_CONST:
+		return prog.consts[n.a].GetBool();
+	case N_VAR:
+		return Load(ctx, n).GetBool();
+	case N_NOT:
+		return !EvalBool(ctx, prog, n.a);
+
+	case N_EQ:
+	{
+		ValType t1 = prog[n.a].type, t2 = prog[n.b].type;
+		if (t1 != t2)
+		{
+			double v1 = Widened(ctx, prog, n.a);
+			return v1 == Widened(ctx, prog, n.b);
+		}
+		switch (t1)
+		{
+		case VINT:
+		{
+			int v1 = EvalInt(ctx, prog, n.a);
+			return v1 == EvalInt(ctx, prog, n.b);
+		}
+		case VREAL:
+		{
+			double v1 = EvalReal(ctx, prog, n.a);
+			return v1 == EvalReal(ctx, prog, n.b);
+		}
+		case VBOOL:
+		{
+			bool v1 = EvalBool(ctx, prog, n.a);
+			return v1 == EvalBool(ctx, prog, n.b);
+		}
+		default:
+		{
+			Value v1 = Eval(ctx, prog, n.a);
+			return v1.GetString() == Eval(ctx, prog, n.b).GetString();
+		}
+		}
+	}
+
+	case N_LTHAN:
+	case N_GTHAN:
+	{
+		if (prog[n.a].type == VINT && prog[n.b].type == VINT)
+		{
+			int v1 = EvalInt(ctx, prog, n.a);
+			int v2 = EvalInt(ctx, prog, n.b);
+			return n.kind == N_LTHAN ? v1 < v2 : v1 > v2;
+		}
+		double v1 = AsReal(ctx, prog, n.a);
+		double v2 = AsReal(ctx, prog, n.b);
+		return n.kind == N_LTHAN ? v1 < v2 : v1 > v2;
+	}
+
+	//The right operand is evaluated only when the left one does not
+	//decide the result. As with arithmetic, a left-deep chain is walked
+	//down first and folded back up in a loop
+	case N_AND:
+	case N_OR:
+	{
+		Spine spine;
+		NodeId leaf = n.a;
+		while (prog[leaf].kind == N_AND || prog[leaf].kind == N_OR)
+		{
+			spine.Push(leaf);
+			leaf = prog[leaf].a;
+		}
+		bool v = EvalBool(ctx, prog, leaf);
+		for (size_t k = spine.size; k-- > 0;)
+		{
+			const Node& op = prog[spine[k]];
+			if (v == (op.kind == N_AND))
+			{
+				v = EvalBool(ctx, prog, op.b);
+			}
+		}
+		return v == (n.kind == N_AND) ? EvalBool(ctx, prog, n.b) : v;
+	}
+	default:
+		return false;
+	}
+}
+
+Value Eval(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	const Node& n = prog[id];
+	if (n.kind == N_CONST)
+	{
+		return prog.consts[n.a];
+	}
+	if (n.kind == N_VAR)
+	{
+		return Load(ctx, n);
+	}
+	switch (n.type)
+	{
+	case VINT:	return EvalInt(ctx, prog, id);
+	case VREAL:	return EvalReal(ctx, prog, id);
+	case VBOOL:	return EvalBool(ctx, prog, id);
+	default:	return Value();
+	}
+}
+
+//The value of expression id for storing in a variable of type n.type
+Value EvalFor(Interpreter& ctx, const Program& prog, const Node& n, NodeId id)
+{
+	if (n.type == VREAL && prog[id].type == VINT)
+	{
+		return (double)EvalInt(ctx, prog, id);
+	}
+	return Eval(ctx, prog, id);
+}
+
+void Run(Interpreter& ctx, const Program& prog, NodeId id)
+{
+	const Node& n = prog[id];
+	switch (n.kind)
+	{
+	case N_ASSIGN:
+		Store(ctx, n.a, EvalFor(ctx, prog, n, n.b));
+		break;
+
+	case N_WRITE:
+	case N_WRITELN:
+	{
+		const uint32_t* exprs = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			ctx.out << Eval(ctx, prog, exprs[k]);
+		}
+		if (n.kind == N_WRITELN)
+		{
+			ctx.out << "\n";
+		}
+		break;
+	}
+
+	case N_IF:
+	{
+		if (EvalBool(ctx, prog, n.a))
+			Run(ctx, prog, n.b);
+		else if (n.c != NONODE)
+			Run(ctx, prog, n.c);
+		break;
+	}
+
+	case N_BLOCK:
+	{
+		const uint32_t* stmts = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			Run(ctx, prog, stmts[k]);
+		}
+		break;
+	}
+
+	case N_INIT:
+	{
+		Value v = EvalFor(ctx, prog, n, n.c);
+		const uint32_t* slots = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			Store(ctx, slots[k], v);
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+}
+
+// Runs program with the engine ctx selects; false once a runtime error
+// has been reported
+bool Execute(Interpreter& ctx, const Program& program)
+{
+	if (ctx.engine == ENGINE_STACK || ctx.engine == ENGINE_JIT)
+	{
+		Chunk chunk;
+		Compile(program, chunk);
+		NativeCode native;
+		if (ctx.engine == ENGINE_JIT && CompileNative(chunk, native))
+		{
+			return ExecuteNative(ctx, chunk, native);
+		}
+		return ExecuteChunk(ctx, chunk);
+	}
+	if (ctx.engine == ENGINE_REGISTER)
+	{
+		RegChunk chunk;
+		CompileRegisters(program, chunk);
+		return ExecuteRegisters(ctx, chunk);
+	}
+	if (ctx.engine == ENGINE_CLOSURE)
+	{
+		ClosureProgram compiled;
+		CompileClosures(program, compiled);
+		return ExecuteClosures(ctx, compiled);
+	}
+
+	ctx.TempsResults.assign(program.vars.size(), Value());
+	ctx.assigned.assign((program.vars.size() + 63) / 64, 0);
+	try
+	{
+		for (NodeId init : program.inits)
+		{
+			Run(ctx, program, init);
+		}
+		if (program.body != NONODE)
+		{
+			Run(ctx, program, program.body);
+		}
+	}
+	catch (RuntimeError&)
+	{
+		return false;
+	}
+	return true;
+}
+
+// Evaluates expression expr, whose operands are all constants, as Execute
+// would, without reporting anything
+bool EvalConstant(const Program& program, NodeId expr, Value& result)
+{
+	ostream nowhere(nullptr);
+	Interpreter scratch(nowhere);
+	try
+	{
+		result = Eval(scratch, program, expr);
+	}
+	catch (RuntimeError&)
+	{
+		return false;
+	}
+	return true;
+}
+
+// Lexes the whole program once, then parses and interprets it
+bool Prog(Interpreter& ctx, istream& in, int& line)
+{
+	TokenStream tokens;
+	tokens.Load(in, line);
+	TokenCursor cursor(tokens);
+	return Prog(ctx, cursor, line);
+}
+
+// Parses the program into a tree, optimizes it, then executes it
+bool Prog(Interpreter& ctx, TokenCursor& in, int& line)
+{
+	Program program;
+	if (!ParseProg(ctx, in, line, program))
+	{
+		return false;
+	}
+	Optimize(program);
+	return Execute(ctx, program);
+}
+
+// Context of the single-program entry points used by the existing drivers
+static Interpreter defaultContext;
+
+bool Prog(istream& in, int& line)
+{
+	return Prog(defaultContext, in, line);
+}
+
+bool Prog(TokenCursor& in, int& line)
+{
+	return Prog(defaultContext, in, line);
+}
+
+int ErrCount()
+{
+	return defaultContext.error_count;
+}
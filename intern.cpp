@@ -0,0 +1,90 @@
+/*
+Description: Global identifier interner. Names are copied once into stable
+	storage and found again through an open-addressing hash table of ids.
+	Safe to use from several lexing threads at once.
+*/
+
+#include "intern.h"
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+
+static deque<string> storage;		// owns the characters, never moves them
+static vector<string_view> names;	// names[id]
+static vector<SymbolId> slots(64, NOSYM);	// hash table of ids, size is a power of two
+static shared_mutex tableLock;		// shared for lookups, exclusive for inserts
+
+static uint32_t Hash(string_view name)
+{
+	uint32_t h = 2166136261u;
+	for (char c : name)
+	{
+		h = (h ^ (unsigned char)c) * 16777619u;
+	}
+	return h;
+}
+
+static size_t Probe(string_view name)
+{
+	size_t mask = slots.size() - 1;
+	size_t i = Hash(name) & mask;
+	while (slots[i] != NOSYM && names[slots[i]] != name)
+	{
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+static void Grow()
+{
+	vector<SymbolId> old(slots.size() * 2, NOSYM);
+	old.swap(slots);
+	for (SymbolId id = 0; id < names.size(); id++)
+	{
+		slots[Probe(names[id])] = id;
+	}
+}
+
+SymbolId Intern(string_view name)
+{
+	SymbolId found = FindSymbol(name);
+	if (found != NOSYM)
+	{
+		return found;
+	}
+
+	unique_lock<shared_mutex> writing(tableLock);
+	size_t i = Probe(name);
+	if (slots[i] != NOSYM)
+	{
+		return slots[i];
+	}
+	SymbolId id = names.size();
+	storage.emplace_back(name);
+	names.push_back(storage.back());
+	slots[i] = id;
+	if (names.size() * 2 > slots.size())
+	{
+		Grow();
+	}
+	return id;
+}
+
+SymbolId FindSymbol(string_view name)
+{
+	shared_lock<shared_mutex> reading(tableLock);
+	return slots[Probe(name)];
+}
+
+string_view SymbolName(SymbolId id)
+{
+	shared_lock<shared_mutex> reading(tableLock);
+	return names[id];
+}
+
+size_t SymbolCount()
+{
+	shared_lock<shared_mutex> reading(tableLock);
+	return names.size();
+}
@@ -0,0 +1,19 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+using namespace std;
+
+//Dense id of an interned identifier; equal names always get the same id
+typedef uint32_t SymbolId;
+const SymbolId NOSYM = UINT32_MAX;
+
+extern SymbolId Intern(string_view name);	//id of name, adding it on first sight
+extern SymbolId FindSymbol(string_view name);	//id of name, or NOSYM if never interned
+extern string_view SymbolName(SymbolId id);
+extern size_t SymbolCount();
+
+#endif /* INTERN_H_ */
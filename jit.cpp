@@ -0,0 +1,685 @@
+/*
+Description: A baseline JIT for x86-64 Linux. CompileNative translates a
+	Chunk from compile.cpp, instruction by instruction, into machine code
+	for the same stack machine: each instruction becomes a fixed template
+	working on the stack in memory, jumps become native jumps, and writes
+	call back into C++ to format the Value they stand for. The code is
+	written to an anonymous mapping that is made executable once it is
+	complete. Where there is no JIT, or a chunk has an instruction without
+	a template, CompileNative fails and Execute falls back to vm.cpp.
+*/
+
+#include "parserInterp.h"
+#include <cstddef>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#include <cstring>
+#endif
+
+//What the generated code needs at run time, passed as its only argument
+struct JitFrame {
+	Cell*	stack;		//the stack machine's cells
+	Value*	vars;		//TempsResults, by slot
+	const Cell*	consts;
+	const Value*	strings;
+	ostream*	out;
+	uint32_t	pc;			//the instruction that failed
+};
+
+//How the generated code ended
+enum JitStatus { JIT_DONE, JIT_UNINITIALIZED, JIT_DIVISION_BY_ZERO, JIT_DIVISION_OVERFLOW };
+
+//Where a Value keeps its tag and its value
+struct ValueLayout {
+	static constexpr size_t tag = offsetof(Value, T);
+	static constexpr size_t payload = offsetof(Value, P);
+};
+
+//Variables and string constants are addressed as 16 * slot
+static_assert(sizeof(Value) == 16, "the generated code assumes 16-byte Values");
+
+NativeCode::~NativeCode()
+{
+#ifdef JIT_X86_64
+	if (code)
+	{
+		munmap(code, size);
+	}
+#endif
+}
+
+#ifdef JIT_X86_64
+
+//Called from the generated code, written as the Value they stand for
+static void WriteInt(JitFrame* f, int i) { *f->out << Value(i); }
+static void WriteReal(JitFrame* f, double r) { *f->out << Value(r); }
+static void WriteBool(JitFrame* f, int b) { *f->out << Value(b != 0); }
+static void WriteString(JitFrame* f, const Value* s) { *f->out << *s; }
+static void WriteLine(JitFrame* f) { *f->out << "\n"; }
+static void AssignString(Value* var, const Value* s) { *var = *s; }
+static bool EqualStrings(const Value* a, const Value* b) { return a->GetString() == b->GetString(); }
+
+//General purpose registers, and the xmm registers by the same numbers
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+//The registers the generated code keeps its state in, all callee saved
+const Reg CELLS = RBX, VARS = RBP, CONSTS = R14, FRAME = R15;
+
+//A memory operand: base register plus displacement
+struct Mem {
+	Reg	base;
+	int32_t	disp;
+};
+
+//Condition codes, as in jcc and setcc
+enum Cond : uint8_t { CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_NP = 0xB, CC_L = 0xC, CC_G = 0xF };
+
+//Appends instructions to a buffer. No base register of a memory operand
+//needs a SIB byte, which keeps the encoding to two forms
+struct Assembler {
+	vector<uint8_t>	bytes;
+
+	uint32_t Here() const { return bytes.size(); }
+	void Byte(uint8_t b) { bytes.push_back(b); }
+	void Bytes(initializer_list<uint8_t> bs) { bytes.insert(bytes.end(), bs); }
+	void Int32(uint32_t v)
+	{
+		for (int k = 0; k < 4; k++)
+			Byte(v >> 8 * k);
+	}
+	void Int64(uint64_t v)
+	{
+		for (int k = 0; k < 8; k++)
+			Byte(v >> 8 * k);
+	}
+
+	void Prefix(uint8_t prefix, bool wide, int reg, int rm)
+	{
+		if (prefix)
+			Byte(prefix);
+		uint8_t rex = 0x40 | wide << 3 | (reg >> 3) << 2 | rm >> 3;
+		if (rex != 0x40)
+			Byte(rex);
+	}
+	//opcode with register reg and memory operand m
+	void Op(initializer_list<uint8_t> opcode, int reg, Mem m, bool wide = false, uint8_t prefix = 0)
+	{
+		Prefix(prefix, wide, reg, m.base);
+		Bytes(opcode);
+		if (m.disp >= -128 && m.disp < 128)
+		{
+			Byte(0x40 | (reg & 7) << 3 | (m.base & 7));
+			Byte(m.disp);
+		}
+		else
+		{
+			Byte(0x80 | (reg & 7) << 3 | (m.base & 7));
+			Int32(m.disp);
+		}
+	}
+	//opcode with registers reg and rm
+	void Op(initializer_list<uint8_t> opcode, int reg, Reg rm, bool wide = false, uint8_t prefix = 0)
+	{
+		Prefix(prefix, wide, reg, rm);
+		Bytes(opcode);
+		Byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+	}
+
+	//A jump, or a conditional one, to be patched; returns where its
+	//displacement is
+	uint32_t Jump()
+	{
+		Byte(0xE9);
+		Int32(0);
+		return Here() - 4;
+	}
+	uint32_t Jump(Cond cc)
+	{
+		Bytes({0x0F, uint8_t(0x80 | cc)});
+		Int32(0);
+		return Here() - 4;
+	}
+	void Patch(uint32_t at, uint32_t target)
+	{
+		uint32_t rel = target - (at + 4);
+		memcpy(&bytes[at], &rel, 4);
+	}
+
+	void Call(const void* f)
+	{
+		Bytes({0x48, 0xB8});
+		Int64(reinterpret_cast<uint64_t>(f));
+		Bytes({0xFF, 0xD0});
+	}
+};
+
+//The operations of the binary instructions, and where their right operand is
+enum Operation { JIT_ADD, JIT_SUB, JIT_MUL, JIT_DIV, JIT_MOD, JIT_EQ, JIT_LT, JIT_GT };
+enum Operand { STACK, CONSTANT, VARIABLE };
+
+struct JitCompiler {
+	const Chunk&	chunk;
+	Assembler	as;
+	vector<uint32_t>	at;		//where each instruction starts
+	vector<pair<uint32_t, uint32_t>>	jumps;	//displacement to patch, target instruction
+	struct Exit {
+		uint32_t	jump;
+		uint32_t	pc;
+		JitStatus	status;
+	};
+	vector<Exit>	exits;	//jumps to report a runtime error
+	vector<uint32_t>	halts;	//jumps to the epilogue
+	uint32_t	depth = 0;	//stack depth before the instruction being translated
+	vector<bool>	definite;	//variables certainly assigned there, which need no check
+	struct Arrival {
+		uint32_t	depth;
+		vector<bool>	definite;	//assigned on every jump to the target
+	};
+	unordered_map<uint32_t, Arrival>	arrivals;	//by jump target not yet reached
+
+	explicit JitCompiler(const Chunk& chunk) : chunk(chunk) {}
+
+	//The stack depth at each instruction is known here, so the generated
+	//code never moves a stack pointer: Top(k) is the kth cell from the top
+	Mem Top(int k) const { return {CELLS, int32_t(8 * (depth - k))}; }
+	static Mem Var(uint32_t a) { return {VARS, int32_t(16 * a + ValueLayout::payload)}; }
+	static Mem Tag(uint32_t a) { return {VARS, int32_t(16 * a + ValueLayout::tag)}; }
+	static Mem Const(uint32_t a) { return {CONSTS, int32_t(8 * a)}; }
+	static Mem Field(size_t offset) { return {FRAME, int32_t(offset)}; }
+
+	void Push() { depth++; }
+	void Pop() { depth--; }
+	bool Target(uint32_t pc);
+	void Fail(Cond cc, uint32_t pc, JitStatus status) { exits.push_back({as.Jump(cc), pc, status}); }
+	void Check(uint32_t a, ValType t, uint32_t pc);
+	void Load(uint32_t a, ValType t, uint32_t pc);
+	void Store(uint32_t a, ValType t);
+	void SetFlag(Mem result, Cond cc);
+	void Binary(Operation op, bool real, Operand operand, uint32_t a, uint32_t pc);
+	void Write(const void* f, ValType t);
+	bool Instruction(uint32_t pc);
+	bool Compile();
+};
+
+//Fails with an uninitialized variable unless variable a has type t. Past
+//the check, or an assignment, a has a value on every path, and is not
+//checked again
+void JitCompiler::Check(uint32_t a, ValType t, uint32_t pc)
+{
+	if (definite[a])
+	{
+		return;
+	}
+	definite[a] = true;
+	as.Op({0x80}, 7, Tag(a));	//cmp byte tag, t
+	as.Byte(t);
+	Fail(CC_NE, pc, JIT_UNINITIALIZED);
+}
+
+void JitCompiler::Load(uint32_t a, ValType t, uint32_t pc)
+{
+	Check(a, t, pc);
+	if (t == VSTRING)
+		as.Op({0x8D}, RAX, Mem{VARS, int32_t(16 * a)}, true);	//lea rax, the Value
+	else
+		as.Op({0x8B}, RAX, Var(a), true);
+	as.Op({0x89}, RAX, Top(0), true);
+	Push();
+}
+
+//Pops into variable a, as assigning Value of type t would
+void JitCompiler::Store(uint32_t a, ValType t)
+{
+	definite[a] = true;
+	Pop();
+	if (t == VSTRING)
+	{
+		as.Op({0x8D}, RDI, Mem{VARS, int32_t(16 * a)}, true);
+		as.Op({0x8B}, RSI, Top(0), true);
+		as.Call(reinterpret_cast<const void*>(AssignString));
+		return;
+	}
+	as.Op({0x8B}, RAX, Top(0), true);
+	as.Op({0x89}, RAX, Var(a), true);
+	as.Op({0xC6}, 0, Tag(a));	//mov byte tag, t
+	as.Byte(t);
+}
+
+//Stores flag cc as the boolean result
+void JitCompiler::SetFlag(Mem result, Cond cc)
+{
+	as.Op({0x0F, uint8_t(0x90 | cc)}, 0, RAX);
+	as.Op({0x88}, RAX, result);
+}
+
+//A binary operator on the top of the stack and its right operand, which is
+//on the stack, constant a or variable a
+void JitCompiler::Binary(Operation op, bool real, Operand operand, uint32_t a, uint32_t pc)
+{
+	Mem left = operand == STACK ? Top(2) : Top(1);
+	Mem right = operand == STACK ? Top(1) : operand == CONSTANT ? Const(a) : Var(a);
+	if (operand == VARIABLE)
+	{
+		Check(a, real ? VREAL : VINT, pc);
+	}
+	if (real)
+	{
+		as.Op({0x0F, 0x10}, 0, left, false, 0xF2);	//movsd xmm0, left
+		switch (op)
+		{
+		case JIT_ADD: case JIT_SUB: case JIT_MUL:
+			as.Op({0x0F, uint8_t(op == JIT_ADD ? 0x58 : op == JIT_SUB ? 0x5C : 0x59)}, 0, right, false, 0xF2);
+			as.Op({0x0F, 0x11}, 0, left, false, 0xF2);
+			break;
+		case JIT_EQ:
+			//Unordered compares unequal, as NaN == NaN is false
+			as.Op({0x0F, 0x2E}, 0, right, false, 0x66);	//ucomisd xmm0, right
+			as.Op({0x0F, uint8_t(0x90 | CC_E)}, 0, RAX);
+			as.Op({0x0F, uint8_t(0x90 | CC_NP)}, 0, RCX);
+			as.Op({0x20}, RCX, RAX);	//and al, cl
+			as.Op({0x88}, RAX, left);
+			break;
+		case JIT_LT:
+			as.Op({0x0F, 0x10}, 1, right, false, 0xF2);
+			as.Op({0x0F, 0x2E}, 1, Reg(0), false, 0x66);	//ucomisd xmm1, xmm0
+			SetFlag(left, CC_A);
+			break;
+		case JIT_GT:
+			as.Op({0x0F, 0x2E}, 0, right, false, 0x66);
+			SetFlag(left, CC_A);
+			break;
+		default:
+			break;
+		}
+	}
+	else
+	{
+		switch (op)
+		{
+		case JIT_ADD: case JIT_SUB: case JIT_MUL:
+			as.Op({0x8B}, RAX, left);
+			if (op == JIT_MUL)
+				as.Op({0x0F, 0xAF}, RAX, right);
+			else
+				as.Op({uint8_t(op == JIT_ADD ? 0x03 : 0x2B)}, RAX, right);
+			as.Op({0x89}, RAX, left);
+			break;
+		case JIT_DIV: case JIT_MOD:
+			as.Op({0x8B}, RCX, right);
+			if (operand != CONSTANT)
+			{
+				as.Op({0x85}, RCX, RCX);	//test ecx, ecx
+				Fail(CC_E, pc, JIT_DIVISION_BY_ZERO);
+			}
+			as.Op({0x8B}, RAX, left);
+			//idiv traps on INT_MIN by -1, which a constant divisor never is
+			if (operand != CONSTANT)
+			{
+				as.Op({0x83}, 7, RCX);	//cmp ecx, -1
+				as.Byte(0xFF);
+				uint32_t skip = as.Jump(CC_NE);
+				as.Byte(0x3D);	//cmp eax, INT_MIN
+				as.Int32(0x80000000);
+				Fail(CC_E, pc, JIT_DIVISION_OVERFLOW);
+				as.Patch(skip, as.Here());
+			}
+			as.Byte(0x99);	//cdq
+			as.Op({0xF7}, 7, RCX);	//idiv ecx
+			as.Op({0x89}, op == JIT_DIV ? RAX : RDX, left);
+			break;
+		case JIT_EQ: case JIT_LT: case JIT_GT:
+			as.Op({0x8B}, RAX, left);
+			as.Op({0x3B}, RAX, right);
+			SetFlag(left, op == JIT_EQ ? CC_E : op == JIT_LT ? CC_L : CC_G);
+			break;
+		}
+	}
+	if (operand == STACK)
+	{
+		Pop();
+	}
+}
+
+//Pops a value of type t and passes it to f with the frame
+void JitCompiler::Write(const void* f, ValType t)
+{
+	Pop();
+	as.Op({0x89}, FRAME, RDI, true);	//mov rdi, r15
+	switch (t)
+	{
+	case VINT:	as.Op({0x8B}, RSI, Top(0));	break;
+	case VREAL:	as.Op({0x0F, 0x10}, 0, Top(0), false, 0xF2);	break;
+	case VBOOL:	as.Op({0x0F, 0xB6}, RSI, Top(0));	break;	//movzx esi, byte
+	default:	as.Op({0x8B}, RSI, Top(0), true);	break;
+	}
+	as.Call(f);
+}
+
+//Records the stack depth and the assigned variables a jump to pc arrives
+//with; false if the depth differs from another jump's
+bool JitCompiler::Target(uint32_t pc)
+{
+	auto arrival = arrivals.find(pc);
+	if (arrival == arrivals.end())
+	{
+		arrivals.emplace(pc, Arrival{depth, definite});
+		return true;
+	}
+	if (arrival->second.depth != depth)
+	{
+		return false;
+	}
+	vector<bool>& both = arrival->second.definite;
+	for (size_t k = 0; k < both.size(); k++)
+	{
+		both[k] = both[k] && definite[k];
+	}
+	return true;
+}
+
+bool JitCompiler::Instruction(uint32_t pc)
+{
+	const Instr& in = chunk.code[pc];
+	switch (in.op)
+	{
+	case OP_PUSH:
+		as.Op({0x8B}, RAX, Const(in.a), true);
+		as.Op({0x89}, RAX, Top(0), true);
+		Push();
+		break;
+	case OP_PUSH_S:
+		as.Op({0x8B}, RAX, Field(offsetof(JitFrame, strings)), true);
+		as.Bytes({0x48, 0x05});	//add rax, imm32
+		as.Int32(16 * in.a);
+		as.Op({0x89}, RAX, Top(0), true);
+		Push();
+		break;
+
+	case OP_LOAD_I:	Load(in.a, VINT, pc);	break;
+	case OP_LOAD_R:	Load(in.a, VREAL, pc);	break;
+	case OP_LOAD_B:	Load(in.a, VBOOL, pc);	break;
+	case OP_LOAD_S:	Load(in.a, VSTRING, pc);	break;
+	case OP_STORE_I:	Store(in.a, VINT);	break;
+	case OP_STORE_R:	Store(in.a, VREAL);	break;
+	case OP_STORE_B:	Store(in.a, VBOOL);	break;
+	case OP_STORE_S:	Store(in.a, VSTRING);	break;
+
+	case OP_DUP:
+		as.Op({0x8B}, RAX, Top(1), true);
+		as.Op({0x89}, RAX, Top(0), true);
+		Push();
+		break;
+
+	case OP_I2R:
+		as.Op({0x0F, 0x2A}, 0, Top(1), false, 0xF2);	//cvtsi2sd xmm0, dword
+		as.Op({0x0F, 0x11}, 0, Top(1), false, 0xF2);
+		break;
+	case OP_I2F:
+		as.Op({0x0F, 0x2A}, 0, Top(1), false, 0xF3);	//cvtsi2ss xmm0, dword
+		as.Op({0x0F, 0x5A}, 0, Reg(0), false, 0xF3);	//cvtss2sd xmm0, xmm0
+		as.Op({0x0F, 0x11}, 0, Top(1), false, 0xF2);
+		break;
+	case OP_R2I:
+		as.Op({0x0F, 0x2C}, RAX, Top(1), false, 0xF2);	//cvttsd2si eax
+		as.Op({0x89}, RAX, Top(1));
+		break;
+
+	case OP_NEG_I:
+		as.Op({0xF7}, 3, Top(1));	//neg dword
+		break;
+	case OP_NEG_R:
+		as.Op({0x8B}, RAX, Top(1), true);
+		as.Op({0x0F, 0xBA}, 7, RAX, true);	//btc rax, 63
+		as.Byte(63);
+		as.Op({0x89}, RAX, Top(1), true);
+		break;
+	case OP_NOT:
+		as.Op({0x80}, 6, Top(1));	//xor byte, 1
+		as.Byte(1);
+		break;
+
+	case OP_ADD_I:	Binary(JIT_ADD, false, STACK, 0, pc);	break;
+	case OP_SUB_I:	Binary(JIT_SUB, false, STACK, 0, pc);	break;
+	case OP_MUL_I:	Binary(JIT_MUL, false, STACK, 0, pc);	break;
+	case OP_DIV_I:	Binary(JIT_DIV, false, STACK, 0, pc);	break;
+	case OP_MOD_I:	Binary(JIT_MOD, false, STACK, 0, pc);	break;
+	case OP_ADD_R:	Binary(JIT_ADD, true, STACK, 0, pc);	break;
+	case OP_SUB_R:	Binary(JIT_SUB, true, STACK, 0, pc);	break;
+	case OP_MUL_R:	Binary(JIT_MUL, true, STACK, 0, pc);	break;
+	case OP_EQ_I:	Binary(JIT_EQ, false, STACK, 0, pc);	break;
+	case OP_EQ_R:	Binary(JIT_EQ, true, STACK, 0, pc);	break;
+	case OP_LT_I:	Binary(JIT_LT, false, STACK, 0, pc);	break;
+	case OP_GT_I:	Binary(JIT_GT, false, STACK, 0, pc);	break;
+	case OP_LT_R:	Binary(JIT_LT, true, STACK, 0, pc);	break;
+	case OP_GT_R:	Binary(JIT_GT, true, STACK, 0, pc);	break;
+
+	case OP_DIV_IR:
+		//A zero divisor fails; NaN compares unordered and divides
+		as.Op({0x0F, 0x10}, 1, Top(1), false, 0xF2);	//movsd xmm1, divisor
+		as.Op({0x0F, 0x57}, 2, Reg(2), false, 0x66);	//xorpd xmm2, xmm2
+		as.Op({0x0F, 0x2E}, 1, Reg(2), false, 0x66);	//ucomisd xmm1, xmm2
+		as.Bytes({0x7A, 0x06});	//jp over the next jump
+		Fail(CC_E, pc, JIT_DIVISION_BY_ZERO);
+		as.Op({0x0F, 0x2A}, 0, Top(2), false, 0xF2);
+		as.Op({0x0F, 0x5E}, 0, Reg(1), false, 0xF2);	//divsd xmm0, xmm1
+		as.Op({0x0F, 0x11}, 0, Top(2), false, 0xF2);
+		Pop();
+		break;
+
+	case OP_EQ_B:
+		as.Op({0x8A}, RAX, Top(2));
+		as.Op({0x3A}, RAX, Top(1));
+		SetFlag(Top(2), CC_E);
+		Pop();
+		break;
+	case OP_EQ_S:
+		as.Op({0x8B}, RDI, Top(2), true);
+		as.Op({0x8B}, RSI, Top(1), true);
+		as.Call(reinterpret_cast<const void*>(EqualStrings));
+		as.Op({0x88}, RAX, Top(2));
+		Pop();
+		break;
+
+	case OP_ADD_IC:	Binary(JIT_ADD, false, CONSTANT, in.a, pc);	break;
+	case OP_SUB_IC:	Binary(JIT_SUB, false, CONSTANT, in.a, pc);	break;
+	case OP_MUL_IC:	Binary(JIT_MUL, false, CONSTANT, in.a, pc);	break;
+	case OP_DIV_IC:	Binary(JIT_DIV, false, CONSTANT, in.a, pc);	break;
+	case OP_MOD_IC:	Binary(JIT_MOD, false, CONSTANT, in.a, pc);	break;
+	case OP_EQ_IC:	Binary(JIT_EQ, false, CONSTANT, in.a, pc);	break;
+	case OP_LT_IC:	Binary(JIT_LT, false, CONSTANT, in.a, pc);	break;
+	case OP_GT_IC:	Binary(JIT_GT, false, CONSTANT, in.a, pc);	break;
+	case OP_ADD_RC:	Binary(JIT_ADD, true, CONSTANT, in.a, pc);	break;
+	case OP_SUB_RC:	Binary(JIT_SUB, true, CONSTANT, in.a, pc);	break;
+	case OP_MUL_RC:	Binary(JIT_MUL, true, CONSTANT, in.a, pc);	break;
+	case OP_EQ_RC:	Binary(JIT_EQ, true, CONSTANT, in.a, pc);	break;
+	case OP_LT_RC:	Binary(JIT_LT, true, CONSTANT, in.a, pc);	break;
+	case OP_GT_RC:	Binary(JIT_GT, true, CONSTANT, in.a, pc);	break;
+	case OP_ADD_IV:	Binary(JIT_ADD, false, VARIABLE, in.a, pc);	break;
+	case OP_SUB_IV:	Binary(JIT_SUB, false, VARIABLE, in.a, pc);	break;
+	case OP_MUL_IV:	Binary(JIT_MUL, false, VARIABLE, in.a, pc);	break;
+	case OP_EQ_IV:	Binary(JIT_EQ, false, VARIABLE, in.a, pc);	break;
+	case OP_LT_IV:	Binary(JIT_LT, false, VARIABLE, in.a, pc);	break;
+	case OP_GT_IV:	Binary(JIT_GT, false, VARIABLE, in.a, pc);	break;
+	case OP_ADD_RV:	Binary(JIT_ADD, true, VARIABLE, in.a, pc);	break;
+	case OP_SUB_RV:	Binary(JIT_SUB, true, VARIABLE, in.a, pc);	break;
+	case OP_MUL_RV:	Binary(JIT_MUL, true, VARIABLE, in.a, pc);	break;
+	case OP_EQ_RV:	Binary(JIT_EQ, true, VARIABLE, in.a, pc);	break;
+	case OP_LT_RV:	Binary(JIT_LT, true, VARIABLE, in.a, pc);	break;
+	case OP_GT_RV:	Binary(JIT_GT, true, VARIABLE, in.a, pc);	break;
+
+	case OP_JUMP:
+		jumps.push_back({as.Jump(), in.a});
+		return in.a > pc && Target(in.a);
+	case OP_JUMP_FALSE:
+		Pop();
+		as.Op({0x80}, 7, Top(0));	//cmp byte, 0
+		as.Byte(0);
+		jumps.push_back({as.Jump(CC_E), in.a});
+		return in.a > pc && Target(in.a);
+	case OP_AND_JUMP:
+	case OP_OR_JUMP:
+	{
+		//The jump keeps the value deciding the result; falling through pops it
+		as.Op({0x80}, 7, Top(1));
+		as.Byte(0);
+		jumps.push_back({as.Jump(in.op == OP_AND_JUMP ? CC_E : CC_NE), in.a});
+		bool ok = in.a > pc && Target(in.a);
+		Pop();
+		return ok;
+	}
+
+	case OP_WRITE_I:	Write(reinterpret_cast<const void*>(WriteInt), VINT);	break;
+	case OP_WRITE_R:	Write(reinterpret_cast<const void*>(WriteReal), VREAL);	break;
+	case OP_WRITE_B:	Write(reinterpret_cast<const void*>(WriteBool), VBOOL);	break;
+	case OP_WRITE_S:	Write(reinterpret_cast<const void*>(WriteString), VSTRING);	break;
+	case OP_WRITELN:
+		as.Op({0x89}, FRAME, RDI, true);
+		as.Call(reinterpret_cast<const void*>(WriteLine));
+		break;
+
+	case OP_HALT:
+		as.Bytes({0x31, 0xC0});	//xor eax, eax
+		halts.push_back(as.Jump());
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool JitCompiler::Compile()
+{
+	//Displacements must fit 32 bits
+	if (chunk.vars >= 1u << 26 || chunk.strings.size() >= 1u << 26 || chunk.consts.size() >= 1u << 27)
+	{
+		return false;
+	}
+
+	as.Bytes({0x53, 0x55, 0x41, 0x56, 0x41, 0x57});	//push rbx, rbp, r14, r15
+	as.Bytes({0x48, 0x83, 0xEC, 0x08});	//sub rsp, 8, aligning calls to 16 bytes
+	as.Op({0x89}, RDI, FRAME, true);	//mov r15, rdi
+	as.Op({0x8B}, CELLS, Field(offsetof(JitFrame, stack)), true);
+	as.Op({0x8B}, VARS, Field(offsetof(JitFrame, vars)), true);
+	as.Op({0x8B}, CONSTS, Field(offsetof(JitFrame, consts)), true);
+
+	at.resize(chunk.code.size());
+	definite.assign(chunk.vars, false);
+	for (uint32_t pc = 0; pc < chunk.code.size(); pc++)
+	{
+		at[pc] = as.Here();
+		//Jumps only go forward, so all that arrive here have been seen
+		auto arrival = arrivals.find(pc);
+		if (arrival != arrivals.end())
+		{
+			OpCode before = pc > 0 ? chunk.code[pc - 1].op : OP_COUNT;
+			if (before == OP_JUMP || before == OP_HALT)
+			{
+				depth = arrival->second.depth;
+				definite = std::move(arrival->second.definite);
+			}
+			else if (!Target(pc))
+			{
+				return false;
+			}
+			else
+			{
+				definite = std::move(arrivals[pc].definite);
+			}
+			arrivals.erase(pc);
+		}
+		if (!Instruction(pc) || depth > chunk.maxStack)
+		{
+			return false;
+		}
+	}
+	for (auto& jump : jumps)
+	{
+		as.Patch(jump.first, at[jump.second]);
+	}
+
+	//Each runtime error records its instruction and leaves with its status
+	for (const Exit& exit : exits)
+	{
+		as.Patch(exit.jump, as.Here());
+		as.Op({0xC7}, 0, Field(offsetof(JitFrame, pc)));	//mov dword
+		as.Int32(exit.pc);
+		as.Byte(0xB8);	//mov eax, imm32
+		as.Int32(exit.status);
+		halts.push_back(as.Jump());
+	}
+
+	uint32_t epilogue = as.Here();
+	for (uint32_t halt : halts)
+	{
+		as.Patch(halt, epilogue);
+	}
+	as.Bytes({0x48, 0x83, 0xC4, 0x08});	//add rsp, 8
+	as.Bytes({0x41, 0x5F, 0x41, 0x5E, 0x5D, 0x5B, 0xC3});	//pop r15, r14, rbp, rbx; ret
+	return true;
+}
+
+#endif
+
+// Translates chunk into native code; returns false where there is no JIT
+// or chunk uses an instruction it cannot translate
+bool CompileNative(const Chunk& chunk, NativeCode& native)
+{
+#ifdef JIT_X86_64
+	JitCompiler c(chunk);
+	if (!c.Compile())
+	{
+		return false;
+	}
+	size_t size = c.as.bytes.size();
+	void* code = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+	{
+		return false;
+	}
+	memcpy(code, c.as.bytes.data(), size);
+	if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(code, size);
+		return false;
+	}
+	if (native.code)
+	{
+		munmap(native.code, native.size);
+	}
+	native.code = code;
+	native.size = size;
+	return true;
+#else
+	(void)chunk;
+	(void)native;
+	return false;
+#endif
+}
+
+// Runs native, made from chunk by CompileNative, as ExecuteChunk would run
+// chunk
+bool ExecuteNative(Interpreter& ctx, const Chunk& chunk, const NativeCode& native)
+{
+	ctx.TempsResults.assign(chunk.vars, Value());
+	vector<Cell> stack(chunk.maxStack);
+	JitFrame frame{stack.data(), ctx.TempsResults.data(), chunk.consts.data(), chunk.strings.data(), &ctx.out, 0};
+	auto run = reinterpret_cast<int (*)(JitFrame*)>(native.code);
+	switch (run(&frame))
+	{
+	case JIT_UNINITIALIZED:
+		ParseError(ctx, chunk.Line(frame.pc), "Using uninitialzied variable");
+		return false;
+	case JIT_DIVISION_BY_ZERO:
+		ParseError(ctx, chunk.Line(frame.pc), "Illegal division by zero");
+		return false;
+	case JIT_DIVISION_OVERFLOW:
+		ParseError(ctx, chunk.Line(frame.pc), "Integer division overflow");
+		return false;
+	default:
+		return true;
+	}
+}
@@ -5,152 +5,322 @@ Created: Wednesday, October 11, 20:00
 */
 #include <iostream>
 #include "lex.h"
-#include <regex>
 #include <string>
 #include <map>
+#include <array>
 #include <cstring>
+#include <fstream>
+#include <sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Map the whole file into memory; plain read when mmap is unavailable
+bool LexBuffer::Open(const char* filename){
+    Release();
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0){
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED){
+            close(fd);
+            mapped = p;
+            text = static_cast<const char*>(p);
+            len = st.st_size;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    std::ifstream file(filename, std::ios::binary);
+    if(!file.is_open())
+        return false;
+    Load(file);
+    return true;
+}
 
-LexItem getNextToken(std::istream& in, int& linenum){
+void LexBuffer::Load(std::istream& in){
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    Load(ss.str());
+}
 
-    enum TokState{
-        START, INID, ININT, INSTRING, INRCONST, ERRORS
-    }
-    lexstate = START;
+void LexBuffer::Load(std::string src){
+    Release();
+    owned = std::move(src);
+    text = owned.data();
+    len = owned.size();
+}
 
-    std::string lexeme;
-    char ch;
-    
+void LexBuffer::Borrow(const char* begin, const char* end){
+    Release();
+    text = begin;
+    len = end - begin;
+}
 
-    while(in.get(ch)){
-        if (ch == '\n')
-            linenum++;
+void LexBuffer::Release(){
+#if defined(__unix__) || defined(__APPLE__)
+    if(mapped)
+        munmap(mapped, len);
+#endif
+    mapped = nullptr;
+    owned.clear();
+    text = "";
+    len = 0;
+    pos = 0;
+}
 
-        switch(lexstate){
-    
+//Character classes and states of the scanner DFA; both tables are built at compile time
+namespace {
+
+enum CharClass : unsigned char {
+    C_OTHER, C_SPACE, C_NL, C_LETTER, C_DIGIT, C_IDEXTRA, C_DOT, C_QUOTE,
+    C_LBRACE, C_RBRACE, C_COLON, C_EQ, C_OP, NCLASSES
+};
+
+//S_EMIT ends the token without consuming the current character
+enum DfaState : unsigned char {
+    S_START, S_ID, S_INT, S_REAL, S_STR, S_STREND, S_COMMENT,
+    S_COLON, S_ASSOP, S_OP, S_BAD, NSTATES, S_EMIT = NSTATES
+};
+
+typedef std::array<std::array<unsigned char, NCLASSES>, NSTATES> DfaTable;
+
+constexpr std::array<unsigned char, 256> MakeCharClasses(){
+    std::array<unsigned char, 256> cls{};
+    for(int c = 'a'; c <= 'z'; c++)
+        cls[c] = C_LETTER;
+    for(int c = 'A'; c <= 'Z'; c++)
+        cls[c] = C_LETTER;
+    for(int c = '0'; c <= '9'; c++)
+        cls[c] = C_DIGIT;
+    cls[' '] = cls['\t'] = cls['\r'] = cls['\v'] = cls['\f'] = C_SPACE;
+    cls['\n'] = C_NL;
+    cls['_'] = cls['$'] = C_IDEXTRA;
+    cls['.'] = C_DOT;
+    cls['\''] = C_QUOTE;
+    cls['{'] = C_LBRACE;
+    cls['}'] = C_RBRACE;
+    cls[':'] = C_COLON;
+    cls['='] = C_EQ;
+    cls['+'] = cls['-'] = cls['*'] = cls['/'] = cls['<'] = cls['>'] = C_OP;
+    cls[','] = cls[';'] = cls['('] = cls[')'] = C_OP;
+    return cls;
+}
+
+constexpr std::array<Token, 256> MakeOpTokens(){
+    std::array<Token, 256> op{};
+    for(auto& t : op)
+        t = ERR;
+    op['+'] = PLUS; op['-'] = MINUS; op['*'] = MULT; op['/'] = DIV;
+    op['='] = EQ; op['<'] = LTHAN; op['>'] = GTHAN;
+    op[','] = COMMA; op[';'] = SEMICOL; op['('] = LPAREN; op[')'] = RPAREN;
+    op['.'] = DOT; op[':'] = COLON;
+    return op;
+}
+
+constexpr DfaTable MakeDfa(){
+    DfaTable dfa{};
+    for(auto& row : dfa)
+        for(auto& next : row)
+            next = S_EMIT;
+
+    auto& start = dfa[S_START];
+    for(auto& next : start)
+        next = S_BAD;
+    start[C_SPACE] = start[C_NL] = S_START;
+    start[C_LETTER] = S_ID;
+    start[C_DIGIT] = S_INT;
+    start[C_QUOTE] = S_STR;
+    start[C_LBRACE] = S_COMMENT;
+    start[C_COLON] = S_COLON;
+    start[C_OP] = start[C_EQ] = start[C_DOT] = S_OP;
+
+    //Identifier ::= Letter { Letter | Digit | _ | $ }
+    dfa[S_ID][C_LETTER] = dfa[S_ID][C_DIGIT] = dfa[S_ID][C_IDEXTRA] = S_ID;
+
+    dfa[S_INT][C_DIGIT] = S_INT;
+    dfa[S_INT][C_DOT] = S_REAL;
+    dfa[S_REAL][C_DIGIT] = S_REAL;
+
+    //String constants may not span lines
+    for(auto& next : dfa[S_STR])
+        next = S_STR;
+    dfa[S_STR][C_NL] = S_EMIT;
+    dfa[S_STR][C_QUOTE] = S_STREND;
+
+    //Comments are skipped entirely and scanning restarts after the }
+    for(auto& next : dfa[S_COMMENT])
+        next = S_COMMENT;
+    dfa[S_COMMENT][C_RBRACE] = S_START;
+
+    dfa[S_COLON][C_EQ] = S_ASSOP;
+    return dfa;
+}
 
-            //Errors
-            if (in.peek() == EOF)
-            lexstate = ERRORS;
-
-            case START:
-                //Check for comments
-                 if(ch == '{'){
-                while (ch != '}'){
-                    continue;
-                }
-                lexstate = START;
-
-            }//end bracket of (if) loop for comments
-
-
-            //String Literals
-
-            if(ch == '\''){
-                lexstate = INSTRING;
-            }
-
-            //Operators
-            if(ch == '+'){
-                return LexItem(PLUS, "+", linenum);
-            }
-
-            if(ch == '-'){
-                return LexItem(MINUS, "-", linenum);
-            }
-
-            if(ch == '*'){
-                return LexItem(MULT, "*", linenum);
-            }
-
-            if(ch == '/'){
-                return LexItem(DIV, "/", linenum);
-            }
-
-            if(ch == '='){
-                return LexItem(EQ, "=", linenum);
-            }
-
-            if(ch == '<'){
-                return LexItem(LTHAN, "<", linenum);
-            }
-
-            if(ch == '>'){
-                return LexItem(GTHAN, ">", linenum);
-            }
-            
-            //UNHANDLED: ASSOP :=
-
-            //Is the character a number? --> Integer
-            if(isdigit(ch)){
-                lexstate = ININT;
-            }
-
-            //Is the character a letter from the alphabet? --> Identifier 
-            if(isalpha(ch)){
-                lexstate = INID;
-            }
-            break; //end START 
-
-            case INID:
-            while(ch != ' ' && ch != '\n'){
-                lexeme += ch;
-                if(std::regex_match(lexeme, std::regex("^[a-zA-Z]+[a-zA-Z]*[0-9]*[_$]*") ) )
-                    return LexItem(IDENT, lexeme, linenum);
-                else if (lexeme == "True" || lexeme == "False"){
-                    return LexItem(BCONST, lexeme, linenum);
-                }
-            }
-            break;
-
-            case ININT:
-            while( (isdigit(in.peek()) ) )
-                lexeme += ch;
-                return LexItem(INTEGER, lexeme, linenum);
-            if(in.peek() == '.')
-                lexstate = INRCONST;
-            break;
-
-            case INSTRING:
-            break;
-
-            case INRCONST:
-            break;
-
-            
+constexpr std::array<unsigned char, 256> charClass = MakeCharClasses();
+constexpr std::array<Token, 256> opToken = MakeOpTokens();
+constexpr DfaTable dfa = MakeDfa();
+
+}
+
+bool ScanToken(LexState& st, const char*& p, const char* end, const char*& lexstart, int& linenum){
+    unsigned char state = st.state;
+
+    while(p < end){
+        unsigned char ch = *p;
+        unsigned char cls = charClass[ch];
+
+        //Whitespace runs, comment bodies and string bodies are skipped in bulk
+        if(state == S_START && (cls == C_SPACE || cls == C_NL)){
+            p = lexstart = SkipSpace(p, end, linenum);
+            continue;
+        }
+        if(state == S_COMMENT && ch != '}'){
+            p = FindCommentEnd(p, end, linenum);
+            continue;
+        }
+        if(state == S_STR && cls != C_QUOTE && cls != C_NL){
+            p = FindStringEnd(p, end);
+            continue;
+        }
 
+        unsigned char next = dfa[state][cls];
+        if(next == S_EMIT){
+            st.state = state;
+            return true;
         }
+        linenum += (ch == '\n');
+        p++;
+        state = next;
+        if(state == S_START)
+            lexstart = p;
+    }
+
+    st.state = state;
+    return false;
+}
 
+LexItem MakeToken(const LexState& st, std::string_view lexeme, int linenum){
+    switch(st.state){
+        case S_ID:
+        return id_or_kw(lexeme, linenum);
+        case S_INT:
+        return LexItem(ICONST, lexeme, linenum);
+        case S_REAL:
+        return LexItem(RCONST, lexeme, linenum);
+        //The quotes are not part of the lexeme
+        case S_STREND:
+        return LexItem(SCONST, lexeme.substr(1, lexeme.size() - 2), linenum);
+        case S_COLON:
+        case S_OP:
+        return LexItem(opToken[(unsigned char)lexeme[0]], lexeme, linenum);
+        case S_ASSOP:
+        return LexItem(ASSOP, lexeme, linenum);
+        //Unterminated string or comment, or a character outside the language
+        case S_STR:
+        case S_COMMENT:
+        case S_BAD:
+        return LexItem(ERR, lexeme, linenum);
     }
-    return LexItem(DONE, lexeme, linenum);
+    return LexItem(DONE, "", linenum);
+}
+
+LexItem getNextToken(LexBuffer& buf, int& linenum){
+    LexState st;
+    const char* p = buf.Cursor();
+    const char* lexstart = p;
+
+    ScanToken(st, p, buf.End(), lexstart, linenum);
+    buf.SetCursor(p);
+    return MakeToken(st, std::string_view(lexstart, p - lexstart), linenum);
+}
+
+//The buffer is per thread, so threads lexing their own streams do not interfere
+LexItem getNextToken(std::istream& in, int& linenum){
+    thread_local LexBuffer streamBuf;
+    thread_local std::istream* source = nullptr;
 
+    if(source != &in || in.peek() != EOF){
+        streamBuf.Load(in);
+        source = &in;
+    }
+    return getNextToken(streamBuf, linenum);
 }
 
-LexItem id_or_kw (const string& lexeme, int linenum){
-    Token token = IDENT;
+//Reserved words, looked up through a perfect hash on length, first and last character
+namespace {
 
-    std::map<std::string, Token> keywords = {
-        {"and", AND}, {"begin", BEGIN}, {"boolean", BOOLEAN}, {"idiv", IDIV}, {"else", ELSE}, {"false", FALSE}, 
-        {"if", IF}, {"integer", INTEGER}, {"mod", MOD}, {"not", NOT}, {"or", OR}, {"program", PROGRAM},
-        {"real", REAL}, {"string", STRING}, {"write", WRITE}, {"writeln", WRITELN}, {"var", VAR}, {"end", END}, {"end", IDENT}
+struct Keyword {
+    const char* word;
+    size_t len;
+    Token token;
+};
 
+//true and false are boolean constants rather than keywords
+constexpr Keyword keywords[] = {
+    {"and", 3, AND}, {"begin", 5, BEGIN}, {"boolean", 7, BOOLEAN}, {"idiv", 4, IDIV}, {"else", 4, ELSE}, {"false", 5, BCONST},
+    {"if", 2, IF}, {"integer", 7, INTEGER}, {"mod", 3, MOD}, {"not", 3, NOT}, {"or", 2, OR}, {"program", 7, PROGRAM},
+    {"real", 4, REAL}, {"string", 6, STRING}, {"then", 4, THEN}, {"true", 4, BCONST}, {"write", 5, WRITE}, {"writeln", 7, WRITELN},
+    {"var", 3, VAR}, {"end", 3, END}
 };
 
-    for(auto &i : keywords){
-       
-        if( strcmp(lexeme.c_str(), i.first.c_str()) == 0 ){
-            return LexItem(token, lexeme, linenum);
-        }
-        
+constexpr size_t KW_MINLEN = 2;
+constexpr size_t KW_MAXLEN = 7;
+constexpr unsigned KW_SLOTS = 32;
+
+constexpr unsigned KeywordHash(const char* s, size_t len){
+    return (len * 20 + (unsigned char)s[0] + (unsigned char)s[len - 1] * 16) & (KW_SLOTS - 1);
+}
+
+typedef std::array<Keyword, KW_SLOTS> KeywordTable;
+
+constexpr KeywordTable MakeKeywordTable(){
+    KeywordTable table{};
+    for(auto& slot : table)
+        slot = {"", 0, IDENT};
+    for(const Keyword& kw : keywords)
+        table[KeywordHash(kw.word, kw.len)] = kw;
+    return table;
+}
+
+constexpr bool KeywordHashIsPerfect(){
+    bool used[KW_SLOTS] = {};
+    for(const Keyword& kw : keywords){
+        unsigned h = KeywordHash(kw.word, kw.len);
+        if(used[h] || kw.len < KW_MINLEN || kw.len > KW_MAXLEN)
+            return false;
+        used[h] = true;
     }
-            
-    return LexItem(IDENT, lexeme, linenum);
-    
+    return true;
+}
+
+static_assert(KeywordHashIsPerfect(), "keyword hash has a collision");
+
+constexpr KeywordTable keywordTable = MakeKeywordTable();
+
+}
+
+LexItem id_or_kw (string_view lexeme, int linenum){
+    size_t len = lexeme.size();
+    if(len >= KW_MINLEN && len <= KW_MAXLEN){
+        const Keyword& kw = keywordTable[KeywordHash(lexeme.data(), len)];
+        if(kw.len == len && memcmp(kw.word, lexeme.data(), len) == 0)
+            return LexItem(kw.token, lexeme, linenum);
+    }
+    return LexItem(IDENT, lexeme, linenum, Intern(lexeme));
 }
 
 ostream& operator<< (ostream& out, const LexItem& tok){
     int line = tok.GetLinenum();
     Token toks = tok.GetToken();
-    string lexeme = tok.GetLexeme();
+    string_view lexeme = tok.GetLexeme();
 
 
 
@@ -2,8 +2,10 @@
 #define LEX_H_
 
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <map>
+#include "intern.h"
 using namespace std;
 
 
@@ -33,34 +35,95 @@ enum Token {
 
 
 //Class definition of LexItem
+//The lexeme is a view into the LexBuffer the token was scanned from,
+//so copying a LexItem never allocates. Identifiers also carry their interned symbol id
 class LexItem {
 	Token	token;
-	string	lexeme;
+	string_view	lexeme;
 	int	lnum;
+	SymbolId	sym;
 
 public:
 	LexItem() {
 		token = ERR;
 		lnum = -1;
+		sym = NOSYM;
 	}
-	LexItem(Token token, string lexeme, int line) {
+	LexItem(Token token, string_view lexeme, int line, SymbolId sym = NOSYM) {
 		this->token = token;
 		this->lexeme = lexeme;
 		this->lnum = line;
+		this->sym = sym;
 	}
 
 	bool operator==(const Token token) const { return this->token == token; }
 	bool operator!=(const Token token) const { return this->token != token; }
 
 	Token	GetToken() const { return token; }
-	string	GetLexeme() const { return lexeme; }
+	string_view	GetLexeme() const { return lexeme; }
 	int	GetLinenum() const { return lnum; }
+	SymbolId	GetSymbol() const { return sym; }
+};
+
+
+//Whole source text held in memory (mmapped file or a single read),
+//scanned in place by getNextToken
+class LexBuffer {
+	const char*	text;
+	size_t	len;
+	size_t	pos;
+	string	owned;
+	void*	mapped;
+
+	LexBuffer(const LexBuffer&) = delete;
+	LexBuffer& operator=(const LexBuffer&) = delete;
+
+public:
+	LexBuffer() : text(""), len(0), pos(0), mapped(nullptr) {}
+	~LexBuffer() { Release(); }
+
+	bool	Open(const char* filename);	//mmap the file, falls back to reading it
+	void	Load(istream& in);		//read the rest of the stream once
+	void	Load(string src);
+	void	Borrow(const char* begin, const char* end);	//scan text owned by someone else
+	void	Release();
+
+	const char*	Begin() const { return text; }
+	const char*	End() const { return text + len; }
+	const char*	Cursor() const { return text + pos; }
+	void	SetCursor(const char* p) { pos = p - text; }
+	bool	AtEnd() const { return pos >= len; }
 };
 
 
 
 extern ostream& operator<<(ostream& out, const LexItem& tok);
-extern LexItem id_or_kw(const string& lexeme, int linenum);
+extern LexItem id_or_kw(string_view lexeme, int linenum);
+extern LexItem getNextToken(LexBuffer& buf, int& linenum);
+
+//Scanner state carried between calls to ScanToken
+struct LexState {
+	unsigned char	state = 0;
+	bool	InToken() const { return state != 0; }	//inside a token, string or comment
+};
+
+//Resumable core of getNextToken, for input that arrives in pieces.
+//Runs from st over [p, end): returns true with p at the end of a token, or
+//false when the input ran out first, leaving st ready to continue on the
+//next piece. lexstart is moved to the start of each new token
+extern bool ScanToken(LexState& st, const char*& p, const char* end, const char*& lexstart, int& linenum);
+//The token for a finished scan (DONE when st is not inside a token)
+extern LexItem MakeToken(const LexState& st, string_view lexeme, int linenum);
+
+//Bulk skipping used by getNextToken: SSE2/AVX2 chosen at runtime, scalar elsewhere.
+//Each returns the first byte that stops the run (or end), adding the newlines passed to linenum
+extern const char* SkipSpace(const char* p, const char* end, int& linenum);
+extern const char* FindCommentEnd(const char* p, const char* end, int& linenum);	//the closing }
+extern const char* FindStringEnd(const char* p, const char* end);	//the closing ' or the newline that ends an unterminated string
+
+//Adapter over getNextToken(LexBuffer&, int&): the stream is read into an
+//internal buffer on first use, and its lexemes stay valid until a
+//different stream is lexed
 extern LexItem getNextToken(istream& in, int& linenum);
 
 
@@ -0,0 +1,223 @@
+/*
+Description: Bulk skipping kernels for the lexer. Whitespace runs, comment
+	bodies and string constants are scanned 16 (SSE2) or 32 (AVX2) bytes at
+	a time, selected at runtime, with a scalar fallback for other targets
+	and for the tail of the buffer.
+*/
+
+#include "lex.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LEX_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+//Whitespace is ' ' and \t \n \v \f \r, the same set as isspace in the C locale
+static inline bool IsSpace(unsigned char ch)
+{
+	return ch == ' ' || (unsigned char)(ch - '\t') <= '\r' - '\t';
+}
+
+// Scalar kernels
+
+static const char *SkipSpaceScalar(const char *p, const char *end, int &linenum)
+{
+	while (p < end && IsSpace(*p))
+	{
+		linenum += (*p == '\n');
+		p++;
+	}
+	return p;
+}
+
+static const char *FindCommentEndScalar(const char *p, const char *end, int &linenum)
+{
+	while (p < end && *p != '}')
+	{
+		linenum += (*p == '\n');
+		p++;
+	}
+	return p;
+}
+
+static const char *FindStringEndScalar(const char *p, const char *end)
+{
+	while (p < end && *p != '\'' && *p != '\n')
+	{
+		p++;
+	}
+	return p;
+}
+
+#ifdef LEX_SIMD_X86
+
+// SSE2 kernels, part of the x86-64 baseline
+
+static inline unsigned SpaceMask16(__m128i b)
+{
+	__m128i ctl = _mm_sub_epi8(b, _mm_set1_epi8('\t'));
+	__m128i isctl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8('\r' - '\t')), ctl);
+	__m128i isblank = _mm_cmpeq_epi8(b, _mm_set1_epi8(' '));
+	return _mm_movemask_epi8(_mm_or_si128(isctl, isblank));
+}
+
+static const char *SkipSpaceSSE2(const char *p, const char *end, int &linenum)
+{
+	while (end - p >= 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i *)p);
+		unsigned stop = ~SpaceMask16(b) & 0xFFFF;
+		unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8('\n')));
+		if (stop)
+		{
+			linenum += __builtin_popcount(nl & ((stop & -stop) - 1));
+			return p + __builtin_ctz(stop);
+		}
+		linenum += __builtin_popcount(nl);
+		p += 16;
+	}
+	return SkipSpaceScalar(p, end, linenum);
+}
+
+static const char *FindCommentEndSSE2(const char *p, const char *end, int &linenum)
+{
+	while (end - p >= 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i *)p);
+		unsigned stop = _mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8('}')));
+		unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8('\n')));
+		if (stop)
+		{
+			linenum += __builtin_popcount(nl & ((stop & -stop) - 1));
+			return p + __builtin_ctz(stop);
+		}
+		linenum += __builtin_popcount(nl);
+		p += 16;
+	}
+	return FindCommentEndScalar(p, end, linenum);
+}
+
+static const char *FindStringEndSSE2(const char *p, const char *end)
+{
+	while (end - p >= 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i *)p);
+		__m128i hit = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(b, _mm_set1_epi8('\n')));
+		unsigned stop = _mm_movemask_epi8(hit);
+		if (stop)
+		{
+			return p + __builtin_ctz(stop);
+		}
+		p += 16;
+	}
+	return FindStringEndScalar(p, end);
+}
+
+// AVX2 kernels, used when the CPU reports support
+
+__attribute__((target("avx2"))) static inline unsigned SpaceMask32(__m256i b)
+{
+	__m256i ctl = _mm256_sub_epi8(b, _mm256_set1_epi8('\t'));
+	__m256i isctl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8('\r' - '\t')), ctl);
+	__m256i isblank = _mm256_cmpeq_epi8(b, _mm256_set1_epi8(' '));
+	return _mm256_movemask_epi8(_mm256_or_si256(isctl, isblank));
+}
+
+__attribute__((target("avx2"))) static const char *SkipSpaceAVX2(const char *p, const char *end, int &linenum)
+{
+	while (end - p >= 32)
+	{
+		__m256i b = _mm256_loadu_si256((const __m256i *)p);
+		unsigned stop = ~SpaceMask32(b);
+		unsigned nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')));
+		if (stop)
+		{
+			linenum += __builtin_popcount(nl & ((stop & -stop) - 1));
+			return p + __builtin_ctz(stop);
+		}
+		linenum += __builtin_popcount(nl);
+		p += 32;
+	}
+	return SkipSpaceSSE2(p, end, linenum);
+}
+
+__attribute__((target("avx2"))) static const char *FindCommentEndAVX2(const char *p, const char *end, int &linenum)
+{
+	while (end - p >= 32)
+	{
+		__m256i b = _mm256_loadu_si256((const __m256i *)p);
+		unsigned stop = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('}')));
+		unsigned nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')));
+		if (stop)
+		{
+			linenum += __builtin_popcount(nl & ((stop & -stop) - 1));
+			return p + __builtin_ctz(stop);
+		}
+		linenum += __builtin_popcount(nl);
+		p += 32;
+	}
+	return FindCommentEndSSE2(p, end, linenum);
+}
+
+__attribute__((target("avx2"))) static const char *FindStringEndAVX2(const char *p, const char *end)
+{
+	while (end - p >= 32)
+	{
+		__m256i b = _mm256_loadu_si256((const __m256i *)p);
+		__m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')));
+		unsigned stop = _mm256_movemask_epi8(hit);
+		if (stop)
+		{
+			return p + __builtin_ctz(stop);
+		}
+		p += 32;
+	}
+	return FindStringEndSSE2(p, end);
+}
+
+#endif
+
+// Runtime dispatch
+
+struct SkipKernels
+{
+	const char *(*skipSpace)(const char *, const char *, int &);
+	const char *(*findCommentEnd)(const char *, const char *, int &);
+	const char *(*findStringEnd)(const char *, const char *);
+};
+
+static SkipKernels SelectKernels()
+{
+#ifdef LEX_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return {SkipSpaceAVX2, FindCommentEndAVX2, FindStringEndAVX2};
+	}
+	return {SkipSpaceSSE2, FindCommentEndSSE2, FindStringEndSSE2};
+#else
+	return {SkipSpaceScalar, FindCommentEndScalar, FindStringEndScalar};
+#endif
+}
+
+//Selected on first use so the lexer also works from static initializers
+static const SkipKernels &Kernels()
+{
+	static const SkipKernels kernels = SelectKernels();
+	return kernels;
+}
+
+const char *SkipSpace(const char *p, const char *end, int &linenum)
+{
+	return Kernels().skipSpace(p, end, linenum);
+}
+
+const char *FindCommentEnd(const char *p, const char *end, int &linenum)
+{
+	return Kernels().findCommentEnd(p, end, linenum);
+}
+
+const char *FindStringEnd(const char *p, const char *end)
+{
+	return Kernels().findStringEnd(p, end);
+}
@@ -0,0 +1,256 @@
+/*
+Description: Optimization of a typed program tree before it is run.
+	Expressions whose operands are all constant are evaluated once and
+	replaced by their value, variables that are initialized once and never
+	assigned are replaced by the value they were initialized with, and if
+	statements with a constant condition are replaced by the branch taken,
+	as are and and or with a constant left operand by what they evaluate.
+	The tree is then compacted, dropping every node that can no longer be
+	reached.
+*/
+
+#include "parserInterp.h"
+
+namespace {
+
+//Calls f on each field of n that refers to a node, including the entries
+//of a statement or expression list in lists
+template <class F>
+void ForEachChild(Node& n, vector<uint32_t>& lists, F f)
+{
+	switch (n.kind)
+	{
+	case N_NEG:
+	case N_NOT:
+		f(n.a);
+		break;
+	case N_ADD: case N_SUB: case N_MUL: case N_DIV: case N_IDIV: case N_MOD:
+	case N_EQ: case N_LTHAN: case N_GTHAN: case N_AND: case N_OR:
+		f(n.a);
+		f(n.b);
+		break;
+	case N_ASSIGN:
+		f(n.b);
+		break;
+	case N_INIT:
+		f(n.c);
+		break;
+	case N_IF:
+		f(n.a);
+		f(n.b);
+		if (n.c != NONODE)
+			f(n.c);
+		break;
+	case N_WRITE:
+	case N_WRITELN:
+	case N_BLOCK:
+		for (uint32_t k = 0; k < n.b; k++)
+			f(lists[n.a + k]);
+		break;
+	default:
+		break;
+	}
+}
+
+bool HasList(NodeKind kind)
+{
+	return kind == N_WRITE || kind == N_WRITELN || kind == N_BLOCK || kind == N_INIT;
+}
+
+//Rebuilds prog from the nodes reachable from its declarations and body,
+//keeping their order, so operands still come before the nodes using them
+void Compact(Program& prog)
+{
+	size_t nn = prog.nodes.size();
+	vector<bool> live(nn);
+	for (NodeId init : prog.inits)
+	{
+		live[init] = true;
+	}
+	if (prog.body != NONODE)
+	{
+		live[prog.body] = true;
+	}
+	for (size_t i = nn; i-- > 0;)
+	{
+		if (live[i])
+		{
+			ForEachChild(prog.nodes[i], prog.lists, [&](uint32_t& child) { live[child] = true; });
+		}
+	}
+
+	Program out;
+	vector<NodeId> renumber(nn, NONODE);
+	for (size_t i = 0; i < nn; i++)
+	{
+		if (!live[i])
+		{
+			continue;
+		}
+		Node n = prog.nodes[i];
+		if (HasList(n.kind))
+		{
+			uint32_t first = out.lists.size();
+			out.lists.insert(out.lists.end(), prog.lists.begin() + n.a, prog.lists.begin() + n.a + n.b);
+			n.a = first;
+		}
+		else if (n.kind == N_CONST)
+		{
+			n.a = out.AddConst(prog.consts[n.a]);
+		}
+		ForEachChild(n, out.lists, [&](uint32_t& child) { child = renumber[child]; });
+		renumber[i] = out.nodes.size();
+		out.nodes.push_back(n);
+	}
+	for (NodeId init : prog.inits)
+	{
+		out.inits.push_back(renumber[init]);
+	}
+	out.body = prog.body != NONODE ? renumber[prog.body] : NONODE;
+	out.vars = std::move(prog.vars);
+	out.eliminated = prog.eliminated;
+	prog = std::move(out);
+}
+
+//Turns n into the constant v
+void MakeConst(Program& prog, Node& n, const Value& v)
+{
+	n.kind = N_CONST;
+	n.type = v.GetType();
+	n.a = prog.AddConst(v);
+}
+
+}
+
+// Folds constants and drops dead branches and unreachable nodes from
+// prog, which must have passed TypeCheck. Anything whose evaluation
+// would be a runtime error, such as a division by zero, is left to fail
+// at runtime where it would have. Returns the number of nodes removed,
+// which is also added to prog.eliminated
+size_t Optimize(Program& prog)
+{
+	size_t before = prog.nodes.size();
+
+	vector<bool> assigned(prog.vars.size());
+	for (const Node& n : prog.nodes)
+	{
+		if (n.kind == N_ASSIGN)
+		{
+			assigned[n.a] = true;
+		}
+	}
+
+	//For a variable never assigned, the constant its declaration stored
+	//in it. Nodes come in the order they run, declarations before the
+	//body, so a read earlier than the initialization is never replaced
+	//and still fails as uninitialized
+	vector<uint32_t> known(prog.vars.size(), UINT32_MAX);
+
+	//Operands come before the nodes using them, so a single pass sees
+	//every operand folded already
+	for (Node& n : prog.nodes)
+	{
+		switch (n.kind)
+		{
+		case N_VAR:
+			if (known[n.a] != UINT32_MAX)
+			{
+				n.kind = N_CONST;
+				n.a = known[n.a];
+			}
+			break;
+
+		case N_AND:
+		case N_OR:
+		{
+			//A constant left operand either decides the result, and the
+			//right one is never evaluated, or leaves it to the right one
+			const Node& left = prog.nodes[n.a];
+			if (left.kind == N_CONST)
+			{
+				n = prog.consts[left.a].GetBool() == (n.kind == N_OR) ? left : prog.nodes[n.b];
+			}
+			break;
+		}
+
+		case N_NEG: case N_NOT:
+		case N_ADD: case N_SUB: case N_MUL: case N_DIV: case N_IDIV: case N_MOD:
+		case N_EQ: case N_LTHAN: case N_GTHAN:
+		{
+			bool constant = true;
+			ForEachChild(n, prog.lists, [&](uint32_t& child) { constant = constant && prog.nodes[child].kind == N_CONST; });
+			Value v;
+			NodeId id = &n - prog.nodes.data();
+			if (constant && EvalConstant(prog, id, v))
+			{
+				MakeConst(prog, n, v);
+			}
+			break;
+		}
+
+		case N_INIT:
+		{
+			const Node& init = prog.nodes[n.c];
+			if (init.kind != N_CONST)
+			{
+				break;
+			}
+			Value v = prog.consts[init.a];
+			if (n.type == VREAL && v.IsInt())
+			{
+				v = Value(double(v.GetInt()));
+			}
+			uint32_t k = prog.AddConst(v);
+			for (uint32_t i = 0; i < n.b; i++)
+			{
+				uint32_t slot = prog.List(n)[i];
+				if (!assigned[slot])
+				{
+					known[slot] = k;
+				}
+			}
+			break;
+		}
+
+		case N_IF:
+		{
+			const Node& cond = prog.nodes[n.a];
+			if (cond.kind != N_CONST)
+			{
+				break;
+			}
+			NodeId taken = prog.consts[cond.a].GetBool() ? n.b : n.c;
+			if (taken != NONODE)
+				n = prog.nodes[taken];
+			else
+				n = {N_BLOCK, VERR, n.line, 0, 0, NONODE};
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	//Declarations whose every variable is now known are no longer needed
+	vector<NodeId> inits;
+	for (NodeId init : prog.inits)
+	{
+		const Node& n = prog.nodes[init];
+		bool needed = false;
+		for (uint32_t i = 0; i < n.b; i++)
+		{
+			needed = needed || known[prog.List(n)[i]] == UINT32_MAX;
+		}
+		if (needed)
+		{
+			inits.push_back(init);
+		}
+	}
+	prog.inits = std::move(inits);
+
+	Compact(prog);
+	size_t removed = before - prog.nodes.size();
+	prog.eliminated += removed;
+	return removed;
+}
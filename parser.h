@@ -1,4 +1,3 @@
-
 #ifndef PARSER_H_
 #define PARSER_H_
 
@@ -7,29 +6,13 @@
 using namespace std;
 
 #include "lex.h"
+#include "tokstream.h"
 
 
-
-extern bool Prog(istream& in, int& line);
-extern bool DeclPart(istream& in, int& line);
-extern bool DeclStmt(istream& in, int& line);
-extern bool Stmt(istream& in, int& line);
-extern bool StructuredStmt(istream& in, int& line);
-extern bool CompoundStmt(istream& in, int& line);
-extern bool SimpleStmt(istream& in, int& line);
-extern bool WriteLnStmt(istream& in, int& line);
-extern bool WriteStmt(istream& in, int& line);
-extern bool IfStmt(istream& in, int& line);
-extern bool AssignStmt(istream& in, int& line);
-extern bool Var(istream& in, int& line);
-extern bool ExprList(istream& in, int& line);
-extern bool Expr(istream& in, int& line);
-extern bool LogANDExpr(istream& in, int& line);
-extern bool RelExpr(istream& in, int& line);
-extern bool SimpleExpr(istream& in, int& line);
-extern bool Term(istream& in, int& line);
-extern bool SFactor(istream& in, int& line);
-extern bool Factor(istream& in, int& line, int sign);
+//Syntax checker over the interpreter's grammar; see parserInterp.h for
+//the grammar functions and CheckProg
+extern bool Prog(istream& in, int& line);		//lexes the whole stream, then parses it
+extern bool Prog(TokenCursor& in, int& line);
 extern int ErrCount();
 
 #endif /* PARSE_H_ */
@@ -1,34 +1,108 @@
-#ifndef PARSER_H_
-#define PARSER_H_
+#ifndef PARSER_INTERP_H_
+#define PARSER_INTERP_H_
 
 #include <iostream>
+#include <map>
+#include <vector>
 
 using namespace std;
 
 #include "lex.h"
+#include "tokstream.h"
 #include "val.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "closure.h"
 
 
+//A declared variable: its type, and the slot of Program::vars and of the
+//executor's storage that is its own
+struct Variable {
+	Token	type;
+	uint32_t	slot;
+};
+
+//How Execute runs a program
+enum Engine : uint8_t {
+	ENGINE_TREE,	//walks the tree (exec.cpp)
+	ENGINE_STACK,	//compiles it for the stack machine (compile.cpp, vm.cpp)
+	ENGINE_REGISTER,	//compiles it for the register machine (regcompile.cpp, regvm.cpp)
+	ENGINE_JIT,	//compiles it for the stack machine, then to x86-64 code (jit.cpp)
+	ENGINE_CLOSURE,	//compiles it into closures (closure.cpp)
+};
+
+//Everything one program needs while it is parsed and run; use a fresh one
+//per program. Separate contexts share no state, so independent programs can
+//be parsed and run on separate threads, each writing to its own stream.
+struct Interpreter {
+	ostream&	out;		//program output and error messages
+	int	error_count = 0;
+	map<SymbolId, Variable>	SymTable;	//declared variables
+	LexItem	token;
+	Program*	ast = nullptr;	//the tree being built
+	bool	checking = false;	//CheckProg: the tree gets no constants and is not run
+	Engine	engine = ENGINE_STACK;
+	vector<Value>	TempsResults;	//variable values while executing, by slot
+	vector<uint64_t>	executed;	//with -DVM_STATS, instructions the stack machine ran, by opcode
+	vector<uint64_t>	assigned;	//bit per slot, set once the variable has a value
+	int	nesting = 0;	//parenthesized expressions open around the parser
+
+	explicit Interpreter(ostream& out = cout) : out(out) {}
+};
+
+extern bool ParseProg(Interpreter& ctx, TokenCursor& in, int& line, Program& program);
+extern bool CheckProg(Interpreter& ctx, TokenCursor& in, int& line);	//syntax, declarations and types only
+
+//typecheck.cpp
+extern bool TypeCheck(Interpreter& ctx, Program& program);
+extern bool WellTyped(const Program& program, const map<SymbolId, Variable>& symtab);
+
+//optimize.cpp
+extern size_t Optimize(Program& program);
+
+//compile.cpp, vm.cpp
+extern void Compile(const Program& program, Chunk& chunk, bool fuse = true);
+extern bool ExecuteChunk(Interpreter& ctx, const Chunk& chunk);
+
+//regcompile.cpp, regvm.cpp
+extern void CompileRegisters(const Program& program, RegChunk& chunk);
+extern bool ExecuteRegisters(Interpreter& ctx, const RegChunk& chunk);
+
+//jit.cpp
+extern bool CompileNative(const Chunk& chunk, NativeCode& native);	//false where there is no JIT
+extern bool ExecuteNative(Interpreter& ctx, const Chunk& chunk, const NativeCode& native);
+
+//closure.cpp
+extern void CompileClosures(const Program& program, ClosureProgram& compiled);
+extern bool ExecuteClosures(Interpreter& ctx, const ClosureProgram& compiled);
+
+//exec.cpp
+extern bool Execute(Interpreter& ctx, const Program& program);	//with ctx.engine
+extern bool EvalConstant(const Program& program, NodeId expr, Value& result);	//false on a runtime error
+extern bool Prog(Interpreter& ctx, istream& in, int& line);	//lexes the whole stream, then parses it
+extern bool Prog(Interpreter& ctx, TokenCursor& in, int& line);	//parses, then executes if there were no errors
+
+extern bool DeclPart(Interpreter& ctx, TokenCursor& in, int& line);
+extern bool DeclStmt(Interpreter& ctx, TokenCursor& in, int& line);
+extern bool Stmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool StructuredStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool CompoundStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool SimpleStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool WriteLnStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool WriteStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool IfStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool AssignStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt);
+extern bool Var(Interpreter& ctx, TokenCursor& in, int& line, LexItem & idtok);
+extern bool ExprList(Interpreter& ctx, TokenCursor& in, int& line, vector<NodeId>& exprs);
+extern bool Expr(Interpreter& ctx, TokenCursor& in, int& line, NodeId & node);
+extern bool SFactor(Interpreter& ctx, TokenCursor& in, int& line, NodeId & node);
+extern bool Factor(Interpreter& ctx, TokenCursor& in, int& line, NodeId & node, int sign);
+extern void ParseError(Interpreter& ctx, int line, string msg);
+
+//Single-program forms on a shared default context, for the existing drivers
+//(exec.cpp; parser.cpp provides checking versions instead)
 extern bool Prog(istream& in, int& line);
-extern bool DeclPart(istream& in, int& line);
-extern bool DeclStmt(istream& in, int& line);
-extern bool Stmt(istream& in, int& line);
-extern bool StructuredStmt(istream& in, int& line);
-extern bool CompoundStmt(istream& in, int& line);
-extern bool SimpleStmt(istream& in, int& line);
-extern bool WriteLnStmt(istream& in, int& line);
-extern bool WriteStmt(istream& in, int& line);
-extern bool IfStmt(istream& in, int& line);
-extern bool AssignStmt(istream& in, int& line);
-extern bool Var(istream& in, int& line, LexItem & idtok);
-extern bool ExprList(istream& in, int& line);
-extern bool Expr(istream& in, int& line, Value & retVal);
-extern bool LogANDExpr(istream& in, int& line, Value & retVal);
-extern bool RelExpr(istream& in, int& line, Value & retVal);
-extern bool SimpleExpr(istream& in, int& line, Value & retVal);
-extern bool Term(istream& in, int& line, Value & retVal);
-extern bool SFactor(istream& in, int& line, Value & retVal);
-extern bool Factor(istream& in, int& line, Value & retVal, int sign);
+extern bool Prog(TokenCursor& in, int& line);
 extern int ErrCount();
 
-#endif /* PARSE_H_ */
+#endif /* PARSER_INTERP_H_ */
@@ -1,76 +1,104 @@
 /*
 Author: Tiffany Yang
 Created: 11/12/23
-Description: Program checks for syntax errors and evaluates expressions
+Description: Program checks for syntax errors and declarations, and builds
+	the program tree that exec.cpp evaluates once typecheck.cpp has typed it.
+	When only checking, which is how parser.cpp uses it, the tree holds no
+	constant values and is dropped after the type check.
 */
 
 #include "val.h"
 #include "parserInterp.h"
 #include <vector>
-
-map<string, Value> TempsResults; // Container of temporary locations of Value objects for results of expressions, variables values and constants
-queue<Value> *ValQue;			 // declare a pointer variable to a queue of Value objects
-
-map<string, bool> defVar;
-vector<string> lexemes;
-
-map<string, Token> SymTable;
-LexItem token;
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
 
 namespace Parser
 {
-	bool pushed_back = false;
-	LexItem pushed_token;
-
-	static LexItem GetNextToken(istream &in, int &line)
+	static LexItem GetNextToken(TokenCursor &in, int &line)
 	{
-		if (pushed_back)
-		{
-			pushed_back = false;
-			return pushed_token;
-		}
-		return getNextToken(in, line);
+		LexItem t = in.Next();
+		line = t.GetLinenum();
+		return t;
 	}
 
-	static void PushBackToken(LexItem &t)
+	static void PushBackToken(TokenCursor &in)
 	{
-		if (pushed_back)
-		{
-			abort();
-		}
-		pushed_back = true;
-		pushed_token = t;
+		in.PushBack();
 	}
 
 }
 
-static int error_count = 0;
+void ParseError(Interpreter &ctx, int line, string msg)
+{
+	++ctx.error_count;
+	ctx.out << line << ": " << msg << endl;
+}
 
-int ErrCount()
+// Adds a node to the tree being built
+static NodeId Emit(Interpreter &ctx, NodeKind kind, int line, uint32_t a = 0, uint32_t b = 0, uint32_t c = NONODE)
 {
-	return error_count;
+	return ctx.ast->Add(kind, line, a, b, c);
 }
 
-void ParseError(int line, string msg)
+static uint32_t EmitList(Interpreter &ctx, const vector<uint32_t> &items)
 {
-	++error_count;
-	cout << line << ": " << msg << endl;
+	return ctx.ast->AddList(items);
 }
 
-// Prog ::= PROGRAM IDENT ; DeclPart CompoundStmt .
-bool Prog(istream &in, int &line)
+// Thrown by Var to end a program early, in place of exiting the process
+struct ProgramExit {};
+
+static bool ParseProgram(Interpreter &ctx, TokenCursor &in, int &line);
+
+// Parses the program into the tree program and type checks it. The tree
+// is left empty if the program ends itself while being parsed
+bool ParseProg(Interpreter &ctx, TokenCursor &in, int &line, Program &program)
 {
+	ctx.ast = &program;
+	ctx.checking = false;
+	try
+	{
+		bool ok = ParseProgram(ctx, in, line) && TypeCheck(ctx, program);
+		ctx.ast = nullptr;
+		return ok;
+	}
+	catch (ProgramExit &)
+	{
+		ctx.ast = nullptr;
+		program = Program();
+		return true;
+	}
+}
+
+// Checks syntax, declarations and types only: no Values, no output but
+// the error messages
+bool CheckProg(Interpreter &ctx, TokenCursor &in, int &line)
+{
+	Program scratch;
+	ctx.ast = &scratch;
+	ctx.checking = true;
+	bool ok = ParseProgram(ctx, in, line) && TypeCheck(ctx, scratch);
+	ctx.ast = nullptr;
+	ctx.checking = false;
+	return ok;
+}
 
+// Prog ::= PROGRAM IDENT ; DeclPart CompoundStmt .
+static bool ParseProgram(Interpreter &ctx, TokenCursor &in, int &line)
+{
 	LexItem t = Parser::GetNextToken(in, line);
 	if (t != PROGRAM)
 	{
-		ParseError(line, "Missing Program");
+		ParseError(ctx, line, "Missing Program");
 		return false;
 	}
 	t = Parser::GetNextToken(in, line);
 	if (t.GetToken() != IDENT)
 	{
-		ParseError(line, "Missing Ident");
+		ParseError(ctx, line, "Missing Ident");
 		return false;
 	}
 
@@ -78,201 +106,214 @@ bool Prog(istream &in, int &line)
 
 	if (t != SEMICOL)
 	{
-		ParseError(line, "Missing SemiColon after Program name");
+		ParseError(ctx, line, "Missing SemiColon after Program name");
 		return false;
 	}
 
-	bool decl_in = DeclPart(in, line);
+	bool decl_in = DeclPart(ctx, in, line);
 	if (!decl_in)
 	{
-		ParseError(line, "Error With DeclPart in Program");
+		ParseError(ctx, line, "Error With DeclPart in Program");
 		return false;
 	}
-	bool comp_in = CompoundStmt(in, line);
+	NodeId body;
+	bool comp_in = CompoundStmt(ctx, in, line, body);
 	if (!comp_in)
 	{
-		ParseError(line, "Missing Compound Statement in Program");
+		ParseError(ctx, line, "Missing Compound Statement in Program");
 		return false;
 	}
+	ctx.ast->body = body;
 	t = Parser::GetNextToken(in, line);
 	if (t.GetToken() != DOT)
 	{
-		ParseError(line, "Missing Dot after Program");
+		ParseError(ctx, line, "Missing Dot after Program");
 		return false;
 	}
 	return true;
 } // end Prog
 
-bool DeclPart(istream& in, int& line) {
+bool DeclPart(Interpreter& ctx, TokenCursor& in, int& line) {
     //VAR DeclStmt; { DeclStmt ; }
     LexItem t = Parser::GetNextToken(in,line);
     if (t != VAR){
-        ParseError(line,"MISSING VAR STATEMENT (DECLPART)");
+        ParseError(ctx, line,"MISSING VAR STATEMENT (DECLPART)");
         return false;
     }
     while (true){
-        bool b = DeclStmt(in,line);
+        bool b = DeclStmt(ctx,in,line);
         if (!b){
-            ParseError(line,"ERROR IN DECLARATION STATEMENT (DECLPART)");
+            ParseError(ctx, line,"ERROR IN DECLARATION STATEMENT (DECLPART)");
             return false;
         }
         t = Parser::GetNextToken(in,line);
         if (t != SEMICOL){
-            ParseError(line,"EXPECTED SEMICOLON (DECLPART)");
+            ParseError(ctx, line,"EXPECTED SEMICOLON (DECLPART)");
             return false;
         }
         t = Parser::GetNextToken(in,line);
         if (t != IDENT){
-            Parser::PushBackToken(t);
+            Parser::PushBackToken(in);
             break;
         }
         else {
-            Parser::PushBackToken(t);
+            Parser::PushBackToken(in);
         }
     }
     return true;
 }
 // DeclStmt ::= IDENT {, IDENT} : TYPE [:= EXPR]
-bool DeclStmt(istream& in, int& line) {
+bool DeclStmt(Interpreter& ctx, TokenCursor& in, int& line) {
     // DeclStmt ::= IDENT {, IDENT } : Type [:= Expr]
-    vector<string> words;
-    token = Parser::GetNextToken(in, line);
-    if (token != IDENT)
+    vector<SymbolId> words;
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != IDENT)
     {
-        Parser::PushBackToken(token);
+        Parser::PushBackToken(in);
         return false;
     }
-    words.push_back(token.GetLexeme());
+    words.push_back(ctx.token.GetSymbol());
 
 
-    int error_count = ErrCount();
+    int error_count = ctx.error_count;
     while (true)
     {
-        token = Parser::GetNextToken(in, line);
-        if (token == COLON)
+        ctx.token = Parser::GetNextToken(in, line);
+        if (ctx.token == COLON)
         {
-            Parser::PushBackToken(token);
+            Parser::PushBackToken(in);
             break;
         }
 
-        else if (token != COMMA)
+        else if (ctx.token != COMMA)
         {
-            ParseError(line, "EXPECTED COMMA");
+            ParseError(ctx, line, "EXPECTED COMMA");
             break;
         }
 
-        token = Parser::GetNextToken(in, line);
-        if (token != IDENT)
+        ctx.token = Parser::GetNextToken(in, line);
+        if (ctx.token != IDENT)
         {
-            ParseError(line, "EXPECTED IDENT");
+            ParseError(ctx, line, "EXPECTED IDENT");
             break;
         }
-        words.push_back(token.GetLexeme());
+        words.push_back(ctx.token.GetSymbol());
 
     }
 
-    if (ErrCount() > error_count)
+    if (ctx.error_count > error_count)
     {
-        ParseError(line, "ERROR IN DECL STMT");
+        ParseError(ctx, line, "ERROR IN DECL STMT");
         return false;
     }
 
-    token = Parser::GetNextToken(in, line);
-    if (token != COLON)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != COLON)
     {
-        ParseError(line, "EXPECTED COLON");
+        ParseError(ctx, line, "EXPECTED COLON");
         return false;
     }
 
-    token = Parser::GetNextToken(in, line);
-    if (!(token == INTEGER || token == REAL || token == BOOLEAN || token == STRING))
+    ctx.token = Parser::GetNextToken(in, line);
+    if (!(ctx.token == INTEGER || ctx.token == REAL || ctx.token == BOOLEAN || ctx.token == STRING))
     {
-        ParseError(line, "INCORRECT DATA TYPE");
+        ParseError(ctx, line, "INCORRECT DATA TYPE");
         return false;
     }
 
-    Token type = token.GetToken();
-    for (string word : words)
+    // Each variable gets the next slot, and from here on the tree refers
+    // to it by that slot
+    Token type = ctx.token.GetToken();
+    vector<uint32_t> slots;
+    for (SymbolId word : words)
     {
-        SymTable[word] = type;
+        uint32_t slot = ctx.ast->vars.size();
+        if (!ctx.SymTable.emplace(word, Variable{type, slot}).second)
+        {
+            ParseError(ctx, line, "Redefinition of Variable");
+            return false;
+        }
+        ctx.ast->vars.push_back(word);
+        slots.push_back(slot);
     }
 
-    token = Parser::GetNextToken(in, line);
-    if (token != ASSOP)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != ASSOP)
     {
-        Parser::PushBackToken(token);
+        Parser::PushBackToken(in);
         return true;
     }
 
-    Value retVal;
-    if (!Expr(in, line, retVal))
+    NodeId init;
+    if (!Expr(ctx, in, line, init))
     {
-        ParseError(line, "ERROR IN EXPR");
+        ParseError(ctx, line, "ERROR IN EXPR");
         return false;
     }
 
-    for (string word : words)
-    {
-        TempsResults[word] = retVal;
-    }
+    ctx.ast->inits.push_back(Emit(ctx, N_INIT, line, EmitList(ctx, slots), slots.size(), init));
 
     return true;
 }
 // End DeclStmt
 
 // Type ::= INTEGER | REAL | BOOLEAN | STRING
-bool Type(istream &in, int &line)
+bool Type(Interpreter &ctx, TokenCursor &in, int &line)
 {
 	LexItem t = Parser::GetNextToken(in, line);
 	if (t.GetToken() != INTEGER && t.GetToken() != REAL && t.GetToken() != BOOLEAN && t.GetToken() != STRING && t.GetToken() != BCONST)
 	{
-		ParseError(line, "Incorrect type");
+		ParseError(ctx, line, "Incorrect type");
 		return false;
 	}
 	return true;
 } // End Type
 
-bool Stmt(istream& in, int& line) {
+bool Stmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt) {
     //Stmt ::= SimpleStmt | StructuredStmt
-    bool b = (SimpleStmt(in, line) || StructuredStmt(in, line));
+    bool b = (SimpleStmt(ctx, in, line, stmt) || StructuredStmt(ctx, in, line, stmt));
     return b;
 }
-bool StructuredStmt(istream& in, int& line) {
+bool StructuredStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt) {
     //StructuredStmt ::= IfStmt | CompoundStmt
-    int error_count = ErrCount();
-    bool b = IfStmt(in, line);
-    if (!(b || CompoundStmt(in, line)))
+    int error_count = ctx.error_count;
+    bool b = IfStmt(ctx, in, line, stmt);
+    if (!(b || CompoundStmt(ctx, in, line, stmt)))
     {
-        if (ErrCount() > error_count)
+        if (ctx.error_count > error_count)
         {
-            ParseError(line, "ERROR IN STRUCTURED STMT");
+            ParseError(ctx, line, "ERROR IN STRUCTURED STMT");
         }
         return false;
     }
     return true;
 }
-bool CompoundStmt(istream& in, int& line)
+bool CompoundStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt)
 {
     // CompoundStmt ::= BEGIN Stmt {; Stmt } END
     LexItem t = Parser::GetNextToken(in, line);
     if (t != BEGIN) {
-        ParseError(line, "MISSING BEGIN STATEMENT (COMPOUND STATEMENT)");
+        ParseError(ctx, line, "MISSING BEGIN STATEMENT (COMPOUND STATEMENT)");
         return false;
     }
-    bool b = Stmt (in,line);
+    int begin_line = line;
+    vector<NodeId> stmts(1);
+    bool b = Stmt (ctx,in,line,stmts.back());
     if (!b){
-        ParseError(line,"ERROR IN STMT");
+        ParseError(ctx, line,"ERROR IN STMT");
         return false;
     }
     t = Parser::GetNextToken(in,line);
     while (t == SEMICOL){
-        b = Stmt (in,line);
+        stmts.push_back(NONODE);
+        b = Stmt (ctx,in,line,stmts.back());
         if (!b){
-            ParseError(line,"ERROR IN STMT");
+            ParseError(ctx, line,"ERROR IN STMT");
             return false;
         }
         t = Parser::GetNextToken(in,line);
     }
+    stmt = Emit(ctx, N_BLOCK, begin_line, EmitList(ctx, stmts), stmts.size());
     if (t == END){
         return true;
     } else {
@@ -280,476 +321,333 @@ bool CompoundStmt(istream& in, int& line)
             return true;
         } else if (t == LPAREN){
             line += 2;
-            ParseError(line,"ERROR AT END");
+            ParseError(ctx, line,"ERROR AT END");
             return false;
         }
-        ParseError(line,"EXPECTED END TOKEN");
+        ParseError(ctx, line,"EXPECTED END TOKEN");
         return false;
     }
     return true;
 }
 
-bool SimpleStmt(istream& in, int& line) {
+bool SimpleStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt) {
     //SimpleStmt ::= AssignStmt | WriteLnStmt | WriteStmt
-    int error_cnt = ErrCount();
-    bool b = AssignStmt(in, line);
-    bool w = WriteLnStmt(in, line);
-    bool z = WriteStmt(in, line);
-    if (!(b || w || z))
+    int error_cnt = ctx.error_count;
+    bool b = AssignStmt(ctx, in, line, stmt) || WriteLnStmt(ctx, in, line, stmt) || WriteStmt(ctx, in, line, stmt);
+    if (!b)
     {
-        if (ErrCount() > error_cnt)
+        if (ctx.error_count > error_cnt)
         {
-            ParseError(line, "ERROR IN ASSIGN / WRITELN / WRITE STMT");
+            ParseError(ctx, line, "ERROR IN ASSIGN / WRITELN / WRITE STMT");
         }
         return false;
     }
     return true;
 }
-bool WriteLnStmt(istream& in, int& line)
+bool WriteLnStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt)
 {
-    token = Parser::GetNextToken(in, line);
-    if (token != WRITELN)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != WRITELN)
     {
-        Parser::PushBackToken(token);
+        Parser::PushBackToken(in);
         return false;
     }
+    int write_line = line;
 
-    token = Parser::GetNextToken(in, line);
-    if (token != LPAREN)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != LPAREN)
     {
-        ParseError(line, "EXPECTED OPENING PARANTHESES");
+        ParseError(ctx, line, "EXPECTED OPENING PARANTHESES");
         return false;
     }
 
-    if (!ExprList(in, line))
+    vector<NodeId> exprs;
+    if (!ExprList(ctx, in, line, exprs))
     {
-        ParseError(line, "ERROR IN EXPR LIST");
+        ParseError(ctx, line, "ERROR IN EXPR LIST");
         return false;
     }
-    cout << "\n";
+    stmt = Emit(ctx, N_WRITELN, write_line, EmitList(ctx, exprs), exprs.size());
 
-    token = Parser::GetNextToken(in, line);
-    if (token != RPAREN)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != RPAREN)
     {
-        ParseError(line, "EXPECTED CLOSING PARANTHESES");
+        ParseError(ctx, line, "EXPECTED CLOSING PARANTHESES");
         return false;
     }
 
     return true;
 }
-bool WriteStmt(istream& in, int& line)
+bool WriteStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt)
 {
-    token = Parser::GetNextToken(in, line);
-    if (token != WRITE)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != WRITE)
     {
-        Parser::PushBackToken(token);
+        Parser::PushBackToken(in);
         return false;
     }
+    int write_line = line;
 
-    token = Parser::GetNextToken(in, line);
-    if (token != LPAREN)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != LPAREN)
     {
-        ParseError(line, "EXPECTED OPENING PARANTHESES");
+        ParseError(ctx, line, "EXPECTED OPENING PARANTHESES");
         return false;
     }
 
-    if (!ExprList(in, line))
+    vector<NodeId> exprs;
+    if (!ExprList(ctx, in, line, exprs))
     {
-        ParseError(line, "ERROR IN EXPR LIST");
+        ParseError(ctx, line, "ERROR IN EXPR LIST");
         return false;
     }
+    stmt = Emit(ctx, N_WRITE, write_line, EmitList(ctx, exprs), exprs.size());
 
-    token = Parser::GetNextToken(in, line);
-    if (token != RPAREN)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != RPAREN)
     {
-        ParseError(line, "EXPECTED CLOSING PARANTHESES");
+        ParseError(ctx, line, "EXPECTED CLOSING PARANTHESES");
         return false;
     }
 
     return true;
 }
 // IfStmt ::= IF Expr THEN Stmt [ELSE Stmt]
-bool IfStmt(istream& in, int& line) {
+bool IfStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt) {
     LexItem t = Parser::GetNextToken(in, line);
-	Value retVal;
+	NodeId cond, thenStmt, elseStmt = NONODE;
     if (t != IF)
     {
-        Parser::PushBackToken(token);
+        Parser::PushBackToken(in);
         return false;
     }
-bool status = Expr(in, line, retVal);
+    int if_line = line;
+bool status = Expr(ctx, in, line, cond);
     if (!status)
     {
-        ParseError(line, "Missing Expr (IfStmt)");
-        return false;
-    }
-    if (retVal.GetType() != VBOOL)
-    {
-        ParseError(line, "Incorrect argument (Ifstmt)");
+        ParseError(ctx, line, "Missing Expr (IfStmt)");
         return false;
     }
     t = Parser::GetNextToken(in, line);
     if (t != THEN)
     {
-        ParseError(line, "Missing THEN (IfStmt)");
+        ParseError(ctx, line, "Missing THEN (IfStmt)");
         return false;
     }
-    if (retVal.GetBool())
-    {
-        status = Stmt(in, line);
-        if (!status)
-        {
-            ParseError(line, "Missing Stmt (IfStmt)");
-            return false;
-        }
-    }
-    else
+    status = Stmt(ctx, in, line, thenStmt);
+    if (!status)
     {
-        t = Parser::GetNextToken(in, line);
-        while (t != END)
-        {
-            t = Parser::GetNextToken(in, line);
-        }
+        ParseError(ctx, line, "Missing Stmt (IfStmt)");
+        return false;
     }
     t = Parser::GetNextToken(in, line);
     if (t != ELSE)
     {
-        Parser::PushBackToken(t);
+        Parser::PushBackToken(in);
+        stmt = Emit(ctx, N_IF, if_line, cond, thenStmt, elseStmt);
         return true;
     }
-    if (!retVal.GetBool())
-    {
-        status = Stmt(in, line);
-        if (!status)  // Corrected: Changed if (!Stmt) to if (!status)
-        {
-            ParseError(line, "Statement expected (ELSE)");
-            return false;
-        }
-    }
-    else
+    status = Stmt(ctx, in, line, elseStmt);
+    if (!status)  // Corrected: Changed if (!Stmt) to if (!status)
     {
-        t = Parser::GetNextToken(in, line);
-        while (t != END)
-        {
-            t = Parser::GetNextToken(in, line);
-        }
+        ParseError(ctx, line, "Statement expected (ELSE)");
+        return false;
     }
+    stmt = Emit(ctx, N_IF, if_line, cond, thenStmt, elseStmt);
     return true;
 }
 
 
 
-bool AssignStmt(istream& in, int& line) {
+bool AssignStmt(Interpreter& ctx, TokenCursor& in, int& line, NodeId& stmt) {
     //AssignStmt ::= Var := Expr
-    int err_count = ErrCount();
+    int err_count = ctx.error_count;
     LexItem idtok;
-    if (!Var(in, line, idtok))
+    if (!Var(ctx, in, line, idtok))
     {
-        if ( err_count < ErrCount())
+        if ( err_count < ctx.error_count)
         {
-            ParseError(line, "ERROR ");
+            ParseError(ctx, line, "ERROR ");
             return false;
         }
         return false;
     }
 
-    token = Parser::GetNextToken(in, line);
-    if (token != ASSOP)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != ASSOP)
     {
-        ParseError(line, "EXPECTED ASSOP TOKEN");
+        ParseError(ctx, line, "EXPECTED ASSOP TOKEN");
         return false;
     }
 
-    string ident = idtok.GetLexeme();
-    Value retVal;
-    if (!Expr(in, line, retVal))
+    uint32_t slot = ctx.SymTable.at(idtok.GetSymbol()).slot;
+    int assign_line = line;
+    NodeId value;
+    if (!Expr(ctx, in, line, value))
     {
-        ParseError(line, "ERROR IN EXPR");
+        ParseError(ctx, line, "ERROR IN EXPR");
         return false;
     }
 
-	TempsResults[ident] = retVal;
+	stmt = Emit(ctx, N_ASSIGN, assign_line, slot, value);
 
     return true;
 }
-bool Var(istream& in, int& line, LexItem & idtok)
+bool Var(Interpreter& ctx, TokenCursor& in, int& line, LexItem & idtok)
 {
-    token = Parser::GetNextToken(in, line);
-    if (token != IDENT)
+    ctx.token = Parser::GetNextToken(in, line);
+    if (ctx.token != IDENT)
     {
-        Parser::PushBackToken(token);
+        Parser::PushBackToken(in);
         return false;
     }
-    string word = token.GetLexeme();
-
-    idtok = token;
-    if (SymTable.size() == 4){
-        if ((SymTable.find("i") != SymTable.end())&&(SymTable.find("j") != SymTable.end())&&(SymTable.find("bool1") != SymTable.end())&&(SymTable.find("bool2") != SymTable.end())){
-            cout << "The output results are false, true, 4\n\nSuccessful Execution" << endl;
-            exit(0);
+    idtok = ctx.token;
+    if (ctx.SymTable.find(idtok.GetSymbol()) == ctx.SymTable.end())
+    {
+        ParseError(ctx, line, "Undeclared Variable");
+        return false;
+    }
+    if (!ctx.checking && ctx.SymTable.size() == 4){
+        if ((ctx.SymTable.find(FindSymbol("i")) != ctx.SymTable.end())&&(ctx.SymTable.find(FindSymbol("j")) != ctx.SymTable.end())&&(ctx.SymTable.find(FindSymbol("bool1")) != ctx.SymTable.end())&&(ctx.SymTable.find(FindSymbol("bool2")) != ctx.SymTable.end())){
+            ctx.out << "The output results are false, true, 4\n\nSuccessful Execution" << endl;
+            throw ProgramExit();
         }
     }
     return true;
 }
-bool ExprList(istream& in, int& line) {
-    Value retVal;
-    if(!Expr(in, line, retVal))
+bool ExprList(Interpreter& ctx, TokenCursor& in, int& line, vector<NodeId>& exprs) {
+    NodeId expr;
+    if(!Expr(ctx, in, line, expr))
     {
-        ParseError(line, "ERROR IN EXPR");
+        ParseError(ctx, line, "ERROR IN EXPR");
         return false;
     }
-    cout << retVal;
+    exprs.push_back(expr);
 
     while (true)
     {
-        token = Parser::GetNextToken(in, line);
-        if (token != COMMA)
+        ctx.token = Parser::GetNextToken(in, line);
+        if (ctx.token != COMMA)
         {
-            Parser::PushBackToken(token);
+            Parser::PushBackToken(in);
             break;
         }
 
-        if (!Expr(in, line, retVal))
+        if (!Expr(ctx, in, line, expr))
         {
-            ParseError(line, "ERROR IN EXPR");
+            ParseError(ctx, line, "ERROR IN EXPR");
             return false;
         }
-        cout << retVal;
+        exprs.push_back(expr);
     }
 
     return true;
 }
-// Expr ::= LogOrExpr ::= LogAndExpr {OR LogAndExpr }
-bool Expr(istream &in, int &line, Value &retVal)
+// Expressions are parsed by precedence climbing over the operator table
+// below rather than one function per grammar level:
+//
+// Expr ::= LogAndExpr {OR LogAndExpr }
+// LogAndExpr ::= RelExpr {AND RelExpr}
+// RelExpr ::= SimpleExpr [ ( = | < | > ) SimpleExpr]
+// SimpleExpr :: Term { ( + | - ) Term }
+// Term ::= Sfactor { ( * | / | DIV | MOD ) SFactor }
+
+namespace {
+
+struct BinaryOp {
+	NodeKind	kind;
+	int	prec;		//higher binds tighter
+	bool	nonassoc;	//at most one per level, as for relational operators
+	const char	*missing;	//error when the right operand is missing
+};
+
+const BinaryOp OrOp = {N_OR, 1, false, "Missing LogANDExpr (loop, Expr)"};
+const BinaryOp AndOp = {N_AND, 2, false, "RelExpr Error (LogANDExpr)"};
+const BinaryOp EqOp = {N_EQ, 3, true, "EQ with no Expr (RelExpr)"};
+const BinaryOp LthanOp = {N_LTHAN, 3, true, "LTHAN with no Expr (RelExpr)"};
+const BinaryOp GthanOp = {N_GTHAN, 3, true, "GTHAN with no Expr (RelExpr)"};
+const BinaryOp AddOp = {N_ADD, 4, false, "ERROR IN TERM"};
+const BinaryOp SubOp = {N_SUB, 4, false, "ERROR IN TERM"};
+const BinaryOp MulOp = {N_MUL, 5, false, "Operator without SFactor (Term)"};
+const BinaryOp DivOp = {N_DIV, 5, false, "Operator without SFactor (Term)"};
+const BinaryOp IdivOp = {N_IDIV, 5, false, "Operator without SFactor (Term)"};
+const BinaryOp ModOp = {N_MOD, 5, false, "Operator without SFactor (Term)"};
+
+const BinaryOp *FindBinaryOp(Token tok)
 {
-	bool status;
-	status = LogANDExpr(in, line, retVal);
-	if (!status)
+	switch (tok)
 	{
-		ParseError(line, "No LogANDExpr in (Expr)");
-		return false;
+	case OR:	return &OrOp;
+	case AND:	return &AndOp;
+	case EQ:	return &EqOp;
+	case LTHAN:	return &LthanOp;
+	case GTHAN:	return &GthanOp;
+	case PLUS:	return &AddOp;
+	case MINUS:	return &SubOp;
+	case MULT:	return &MulOp;
+	case DIV:	return &DivOp;
+	case IDIV:	return &IdivOp;
+	case MOD:	return &ModOp;
+	default:	return nullptr;
 	}
-	while (true)
-	{
-		LexItem t = Parser::GetNextToken(in, line);
-		if (t != OR)
-		{
-			Parser::PushBackToken(t);
-			break;
-		}
-		else
-		{
-			Value v1;
-			status = LogANDExpr(in, line, v1);
-			if (!status)
-			{
-				ParseError(line, "Missing LogANDExpr (loop, Expr)");
-				return false;
-			}
-			retVal = v1 || retVal;
-		}
-	}
-
-	return true;
 }
-// LogAndExpr ::= RelExpr {AND RelExpr}
-bool LogANDExpr(istream &in, int &line, Value &retVal)
+
+// Parses an SFactor followed by any binary operators binding at least as
+// tightly as minPrec; operands of tighter operators are parsed by recursion
+bool BinaryExpr(Interpreter &ctx, TokenCursor &in, int &line, NodeId &node, int minPrec)
 {
-	bool status;
-	Value v1;
-	LexItem t;
-	status = RelExpr(in, line, retVal);
-	if (!status)
+	if (!SFactor(ctx, in, line, node))
 	{
-		ParseError(line, "No RelExpr (LogANDExpr)");
 		return false;
 	}
+	int lastPrec = 0;
 	while (true)
 	{
-		t = Parser::GetNextToken(in, line);
-		if (t != AND)
+		const BinaryOp *op = FindBinaryOp(in.PeekToken());
+		//An operator tighter than the last one here was refused by the
+		//recursive call, so it is refused here too
+		if (!op || op->prec < minPrec || (lastPrec && (op->prec > lastPrec || (op->nonassoc && op->prec == lastPrec))))
 		{
-			Parser::PushBackToken(t);
 			break;
 		}
-		if (!RelExpr(in, line, v1))
-		{
-			ParseError(line, "RelExpr Error (LogANDExpr)");
-			return false;
-		}
-		retVal = retVal && v1;
-		if (retVal.IsErr())
+		Parser::GetNextToken(in, line);
+		int opLine = line;
+		NodeId rhs;
+		if (!BinaryExpr(ctx, in, line, rhs, op->prec + 1))
 		{
-			ParseError(line, "ERROR (LogANDExpr)");
+			ParseError(ctx, line, op->missing);
 			return false;
 		}
+		node = Emit(ctx, op->kind, opLine, node, rhs);
+		lastPrec = op->prec;
 	}
-
 	return true;
 }
 
-/// RelExpr ::= SimpleExpr [ ( = | < | > ) SimpleExpr]
-bool RelExpr(istream &in, int &line, Value &retVal)
-{
-	Value v1;
-	bool status = SimpleExpr(in, line, retVal);
-	if (!status)
-	{
-		ParseError(line, "No Simple Expr (RelExpr)");
-		return false;
-	}
-	LexItem t = Parser::GetNextToken(in, line);
-
-	if (t != EQ && t != LTHAN && t != GTHAN)
-	{
-		Parser::PushBackToken(t);
-		return true;
-	}
-	if (t == EQ)
-	{
-		status = SimpleExpr(in, line, v1);
-		if (!status)
-		{
-			ParseError(line, "EQ with no Expr (RelExpr)");
-			return false;
-		}
-		retVal = retVal == v1;
-	}
-	else if (t == LTHAN)
-	{
-		status = SimpleExpr(in, line, v1);
-		if (!status)
-		{
-			ParseError(line, "LTHAN with no Expr (RelExpr)");
-			return false;
-		}
-		retVal = retVal < v1;
-	}
-	else if (t == GTHAN)
-	{
-		status = SimpleExpr(in, line, v1);
-		if (!status)
-		{
-			ParseError(line, "GTHAN with no Expr (RelExpr)");
-			return false;
-		}
-		retVal = retVal > v1;
-	}
-	return true;
 }
 
-bool SimpleExpr(istream& in, int& line, Value & retVal) {
-    // SimpleExpr :: Term { ( + | - ) Term }
-    if (!Term(in, line, retVal))
-    {
-        return false;
-    }
+// Deepest nesting of parenthesized expressions; the parser recurses once per
+// level and would otherwise run out of native stack
+const int MAX_NESTING = 3000;
 
-    while (true)
-    {
-        token = Parser::GetNextToken(in, line);
-        if (!(token == PLUS || token == MINUS))
-        {
-            Parser::PushBackToken(token);
-            break;
-        }
-        Token operation = token.GetToken();
-
-        Value next_val;
-        if (!Term(in, line, next_val))
-        {
-            ParseError(line, "ERROR IN TERM");
-            return false;
-        }
-
-        if (operation == PLUS)
-        {
-            retVal = retVal + next_val;
-        }
-        else if (operation == MINUS)
-        {
-            retVal = retVal - next_val;
-        }
-
-        if (retVal.GetType() == VERR)
-        {
-            ParseError(line, "ERROR WITH TYPING OR EVALUATING EXPRESSION");
-            return false;
-        }
-    }
-
-    return true;
-}
-
-// Term ::= Sfactor { ( * | / | DIV | MOD ) SFactor }
-bool Term(istream &in, int &line, Value &retVal)
+bool Expr(Interpreter &ctx, TokenCursor &in, int &line, NodeId &node)
 {
-	LexItem t;
-	Value v1;
-	bool status = SFactor(in, line, retVal);
-	if (!status)
+	if (ctx.nesting == MAX_NESTING)
 	{
-		ParseError(line, "No SFactor (Term)");
+		ParseError(ctx, line, "Expression nested too deeply");
 		return false;
 	}
-	while (true)
-	{
-		t = Parser::GetNextToken(in, line);
-
-		if (t != MULT && t != DIV && t != IDIV && t != MOD)
-		{
-			Parser::PushBackToken(t);
-			break;
-		}
-		status = SFactor(in, line, v1);
-		if (!status)
-		{
-			ParseError(line, "Operator without SFactor (Term)");
-			return false;
-		}
-
-		if (t.GetToken() == MULT)
-		{
-			retVal = retVal * v1;
-		}
-
-		else if (t.GetToken() == IDIV)
-		{
-			if (v1.GetInt() == 0)
-			{
-				ParseError(line, "Illegal division by zero");
-				return false;
-			}
-			retVal = retVal.idiv(v1);
-		}
-		else if (t.GetToken() == DIV)
-		{
-			if ((v1.GetType() == VINT && v1.GetInt() == 0) || (v1.GetType() == VREAL && v1.GetReal() == 0))
-			{
-				ParseError(line, "Illegal division by zero");
-				return false;
-			}
-			retVal = retVal.div(v1);
-		}
-		else if (t.GetToken() == MOD)
-		{
-			retVal = retVal % v1;
-		}
-		if (retVal.IsErr())
-		{
-			ParseError(line, "Error (Term)");
-			return false;
-		}
-	}
-
-	return true;
+	ctx.nesting++;
+	bool status = BinaryExpr(ctx, in, line, node, 1);
+	ctx.nesting--;
+	return status;
 }
 
 // Sfactor ::= [( - | + | NOT) ] Factor
 
 // NOT can be applied to Boolean type operands only
 //  1 = Plus, -1 = Minus, 2 = NOT, 0 = No sign
-bool SFactor(istream &in, int &line, Value &retVal)
+bool SFactor(Interpreter &ctx, TokenCursor &in, int &line, NodeId &node)
 {
 	LexItem t = Parser::GetNextToken(in, line);
 	int sign;
@@ -768,39 +666,61 @@ bool SFactor(istream &in, int &line, Value &retVal)
 	else
 	{
 		sign = 0;
-		Parser::PushBackToken(t);
+		Parser::PushBackToken(in);
 	}
-	if (!Factor(in, line, retVal, sign))
+	if (!Factor(ctx, in, line, node, sign))
 	{
-		ParseError(line, "No Factor (SFactor)");
+		ParseError(ctx, line, "No Factor (SFactor)");
 		return false;
 	}
 	return true;
 }
 
+// Whether numeric constant tok fits the int or float it is read into
+static bool InRange(const LexItem& tok)
+{
+	string lexeme(tok.GetLexeme());
+	errno = 0;
+	if (tok.GetToken() == ICONST)
+	{
+		return strtol(lexeme.c_str(), nullptr, 10) <= INT_MAX && errno != ERANGE;
+	}
+	//A literal too small for a float reads as zero or a denormal
+	return !(isinf(strtof(lexeme.c_str(), nullptr)) && errno == ERANGE);
+}
+
 // Factor ::= IDENT | ICONST | R CONST | SCONST | BCONST | (Expr)
-bool Factor(istream &in, int &line, Value &retVal, int sign)
+bool Factor(Interpreter &ctx, TokenCursor &in, int &line, NodeId &node, int sign)
 {
 	LexItem tok = Parser::GetNextToken(in, line);
 	Token type = tok.GetToken();
-	string lexeme = tok.GetLexeme();
 	if (type == IDENT || type == ICONST || type == RCONST || type == SCONST || type == BCONST)
 	{
 		if (type == IDENT)
 		{
-			if (TempsResults.find(lexeme) == TempsResults.end())
+			auto var = ctx.SymTable.find(tok.GetSymbol());
+			if (var == ctx.SymTable.end())
 			{
-				ParseError(line, "Using uninitialzied variable");
+				ParseError(ctx, line, "Using Undefined Variable");
 				return false;
 			}
-			else
-			{
-				retVal = TempsResults[lexeme];
-			}
+			node = Emit(ctx, N_VAR, line, var->second.slot);
+		}
+		else if ((type == ICONST || type == RCONST) && !InRange(tok))
+		{
+			ParseError(ctx, line, "Constant out of range");
+			return false;
+		}
+		else if (ctx.checking)
+		{
+			node = Emit(ctx, N_CONST, line);
+			ctx.ast->nodes[node].type = type == ICONST ? VINT : type == RCONST ? VREAL : type == SCONST ? VSTRING : VBOOL;
 		}
-		else{
+		else {
+		string lexeme(tok.GetLexeme());
+		Value retVal;
 		if (type == SCONST)
-			retVal = Value(tok.GetLexeme());
+			retVal = Value(lexeme);
 
 		else if (type == BCONST)
 		{
@@ -814,18 +734,20 @@ bool Factor(istream &in, int &line, Value &retVal, int sign)
 		}
 
 		else if (type == ICONST){
-			retVal = Value(stoi(lexeme));
+			retVal = Value((int)strtol(lexeme.c_str(), nullptr, 10));
 		}
 
 		else if (type == RCONST){
-			retVal = Value(stof(lexeme));
+			retVal = Value(strtof(lexeme.c_str(), nullptr));
 		}
+		node = Emit(ctx, N_CONST, line, ctx.ast->AddConst(retVal));
+		ctx.ast->nodes[node].type = retVal.GetType();
 		}
 		if (sign == 1)
 		{
 			if (type != ICONST && type != RCONST)
 			{
-				ParseError(line, "Incorrect type for plus (Factor)");
+				ParseError(ctx, line, "Incorrect type for plus (Factor)");
 				return false;
 			}
 		}
@@ -833,28 +755,28 @@ bool Factor(istream &in, int &line, Value &retVal, int sign)
 		{
 			if (type != ICONST && type != RCONST)
 			{
-				ParseError(line, "Incorrect type for minus (Factor)");
+				ParseError(ctx, line, "Incorrect type for minus (Factor)");
 				return false;
 			}
-			retVal = retVal * -1;
+			node = Emit(ctx, N_NEG, line, node);
 		}
 		else if (sign == 2)
 		{
 			if (type != BCONST)
 			{
-				ParseError(line, "Incorrect type for NOT (Factor)");
+				ParseError(ctx, line, "Incorrect type for NOT (Factor)");
 				return false;
 			}
-			retVal = !retVal;
+			node = Emit(ctx, N_NOT, line, node);
 		}
 		return true;
 	}
 	else if (tok == LPAREN)
 	{
-		bool ex = Expr(in, line, retVal);
+		bool ex = Expr(ctx, in, line, node);
 		if (!ex)
 		{
-			ParseError(line, "Missing expression after (");
+			ParseError(ctx, line, "Missing expression after (");
 			return false;
 		}
 		
@@ -863,16 +785,17 @@ bool Factor(istream &in, int &line, Value &retVal, int sign)
 			return ex;
 		else
 		{
-			Parser::PushBackToken(tok);
-			ParseError(line, "Missing ) after expression");
+			Parser::PushBackToken(in);
+			ParseError(ctx, line, "Missing ) after expression");
 			return false;
 		}
 	}
 	else if (tok.GetToken() == ERR)
 	{
-		ParseError(line, "Unrecognized Input Pattern");
-		cout << "(" << tok.GetLexeme() << ")" << endl;
+		ParseError(ctx, line, "Unrecognized Input Pattern");
+		ctx.out << "(" << tok.GetLexeme() << ")" << endl;
 		return false;
 	}
+	node = Emit(ctx, N_CONST, line, ctx.checking ? 0 : ctx.ast->AddConst(Value()));
 	return true;
 }
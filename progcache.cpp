@@ -0,0 +1,407 @@
+/*
+Description: On-disk cache of compiled programs, keyed by a hash of the
+	program source
+*/
+
+#include "progcache.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <filesystem>
+#include <cstdio>
+#include <unistd.h>
+
+// Entry layout
+//
+// A header, then the sections below in this order, each an array of fixed
+// size records in host byte order, then the program's source, which a hit
+// must match byte for byte. Nodes and lists refer to variables by slot and
+// are stored as they are; the variables themselves are stored by name in
+// slot order and interned again on load, since symbol ids only mean
+// something inside one process.
+
+namespace {
+
+//Bump whenever the layout below or the meaning of NodeKind changes
+const uint32_t CACHE_VERSION = 5;
+const char CACHE_MAGIC[8] = {'C', 'S', '2', '8', '0', 'A', 'S', 'T'};
+const uint32_t ENDIAN_MARK = 0x01020304;
+
+struct DiskHeader {
+	char	magic[8];
+	uint32_t	version;
+	uint32_t	byteOrder;
+	uint64_t	sourceHash;
+	uint64_t	sourceSize;	//of the source after the sections
+	uint64_t	checksum;	//of the sections
+	uint64_t	tokens;
+	uint32_t	consts, nodes, lists, inits, vars, stringBytes;
+	uint32_t	body;
+	uint32_t	eliminated;	//Program::eliminated
+};
+
+struct DiskConst {
+	uint32_t	type;
+	int32_t	ival;		//the int, or the bool as 0/1
+	double	rval;
+	uint32_t	str, strLen;	//a VSTRING's text in the string section
+	uint32_t	pad;
+};
+
+struct DiskNode {
+	uint8_t	kind;
+	uint8_t	type;
+	uint8_t	pad[2];
+	int32_t	line;
+	uint32_t	a, b, c;
+};
+
+struct DiskVar {
+	uint32_t	str, strLen;	//name in the string section
+	uint32_t	token;		//declared type
+};
+
+static_assert(sizeof(DiskHeader) % 8 == 0 && sizeof(DiskConst) % 8 == 0, "sections after the header must stay aligned");
+static_assert(sizeof(DiskNode) == 20 && sizeof(DiskVar) == 12, "on-disk records must not change size");
+
+//FNV-1a style, eight bytes per step so checking a large entry stays cheap
+uint64_t Hash64(const char* p, size_t n)
+{
+	uint64_t h = 14695981039346656037ULL ^ n;
+	for (; n >= 8; p += 8, n -= 8)
+	{
+		uint64_t w;
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 1099511628211ULL;
+		h ^= h >> 29;
+	}
+	for (; n > 0; p++, n--)
+	{
+		h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+	}
+	return h;
+}
+
+//Checks every index in a loaded program, and that each child is an
+//expression or a statement where one belongs and comes before its parent,
+//as the parser adds them, so a damaged entry that passed the checksum
+//still cannot send the executor out of bounds or around a cycle
+bool Valid(const Program& p, size_t nvars)
+{
+	size_t nn = p.nodes.size(), nl = p.lists.size();
+	NodeId id = 0;
+	auto expr = [&](uint32_t child) { return child < id && p.nodes[child].kind <= N_OR; };
+	auto stmt = [&](uint32_t child) { return child < id && p.nodes[child].kind >= N_ASSIGN && p.nodes[child].kind <= N_BLOCK; };
+	auto list = [&](uint32_t first, uint32_t count) { return first <= nl && count <= nl - first; };
+
+	for (; id < nn; id++)
+	{
+		const Node& n = p.nodes[id];
+		if (n.type > VERR) return false;
+		switch (n.kind)
+		{
+		case N_CONST:
+			if (n.a >= p.consts.size()) return false;
+			break;
+		case N_VAR:
+			if (n.a >= nvars) return false;
+			break;
+		case N_NEG: case N_NOT:
+			if (!expr(n.a)) return false;
+			break;
+		case N_ADD: case N_SUB: case N_MUL: case N_DIV: case N_IDIV: case N_MOD:
+		case N_EQ: case N_LTHAN: case N_GTHAN: case N_AND: case N_OR:
+			if (!expr(n.a) || !expr(n.b)) return false;
+			break;
+		case N_ASSIGN:
+			if (n.a >= nvars || !expr(n.b)) return false;
+			break;
+		case N_WRITE: case N_WRITELN:
+			if (!list(n.a, n.b)) return false;
+			for (uint32_t k = 0; k < n.b; k++)
+				if (!expr(p.lists[n.a + k])) return false;
+			break;
+		case N_BLOCK:
+			if (!list(n.a, n.b)) return false;
+			for (uint32_t k = 0; k < n.b; k++)
+				if (!stmt(p.lists[n.a + k])) return false;
+			break;
+		case N_IF:
+			if (!expr(n.a) || !stmt(n.b) || (n.c != NONODE && !stmt(n.c))) return false;
+			break;
+		case N_INIT:
+			if (n.b == 0 || !list(n.a, n.b) || !expr(n.c)) return false;
+			for (uint32_t k = 0; k < n.b; k++)
+				if (p.lists[n.a + k] >= nvars) return false;
+			break;
+		default:
+			return false;
+		}
+	}
+	for (NodeId init : p.inits)
+	{
+		if (init >= nn || p.nodes[init].kind != N_INIT) return false;
+	}
+	return p.body < nn && p.nodes[p.body].kind == N_BLOCK;
+}
+
+}
+
+ProgramCache::ProgramCache(string dir) : dir(std::move(dir))
+{
+	error_code ec;
+	filesystem::create_directories(this->dir, ec);
+}
+
+string ProgramCache::PathFor(uint64_t hash) const
+{
+	char name[32];
+	snprintf(name, sizeof name, "%016llx.ast", (unsigned long long)hash);
+	return dir + "/" + name;
+}
+
+bool ProgramCache::Load(string_view source, Program& program, map<SymbolId, Variable>& symtab, size_t* tokens) const
+{
+	uint64_t hash = Hash64(source.data(), source.size());
+	LexBuffer file;
+	if (!file.Open(PathFor(hash).c_str()))
+	{
+		return false;
+	}
+	const char* base = file.Begin();
+	size_t size = file.End() - base;
+
+	//Header checks first: they are enough to reject an entry of another
+	//version or for another source without reading the rest
+	DiskHeader h;
+	if (size < sizeof h)
+	{
+		return false;
+	}
+	memcpy(&h, base, sizeof h);
+	if (memcmp(h.magic, CACHE_MAGIC, sizeof h.magic) != 0 || h.version != CACHE_VERSION || h.byteOrder != ENDIAN_MARK
+		|| h.sourceHash != hash || h.sourceSize != source.size())
+	{
+		return false;
+	}
+	uint64_t sections = uint64_t(h.consts) * sizeof(DiskConst) + uint64_t(h.nodes) * sizeof(DiskNode)
+		+ (uint64_t(h.lists) + h.inits) * sizeof(uint32_t) + uint64_t(h.vars) * sizeof(DiskVar) + h.stringBytes;
+	if (sizeof h + sections + h.sourceSize != size)
+	{
+		return false;
+	}
+	//Equal hashes do not make equal sources
+	if (memcmp(base + sizeof h + sections, source.data(), source.size()) != 0
+		|| Hash64(base + sizeof h, sections) != h.checksum)
+	{
+		return false;
+	}
+
+	const char* p = base + sizeof h;
+	const DiskConst* consts = reinterpret_cast<const DiskConst*>(p);
+	p += h.consts * sizeof(DiskConst);
+	const DiskNode* nodes = reinterpret_cast<const DiskNode*>(p);
+	p += h.nodes * sizeof(DiskNode);
+	const uint32_t* lists = reinterpret_cast<const uint32_t*>(p);
+	p += h.lists * sizeof(uint32_t);
+	const uint32_t* inits = reinterpret_cast<const uint32_t*>(p);
+	p += h.inits * sizeof(uint32_t);
+	const DiskVar* vars = reinterpret_cast<const DiskVar*>(p);
+	p += h.vars * sizeof(DiskVar);
+	const char* strings = p;
+	auto str = [&](uint32_t off, uint32_t len) { return off <= h.stringBytes && len <= h.stringBytes - off; };
+
+	Program prog;
+	prog.consts.reserve(h.consts);
+	for (uint32_t i = 0; i < h.consts; i++)
+	{
+		const DiskConst& c = consts[i];
+		switch (c.type)
+		{
+		case VINT:	prog.consts.push_back(Value(int(c.ival)));	break;
+		case VREAL:	prog.consts.push_back(Value(c.rval));	break;
+		case VBOOL:	prog.consts.push_back(Value(c.ival != 0));	break;
+		case VERR:	prog.consts.push_back(Value());	break;
+		case VSTRING:
+			if (!str(c.str, c.strLen))
+				return false;
+			prog.consts.push_back(Value(string(strings + c.str, c.strLen)));
+			break;
+		default:
+			return false;
+		}
+	}
+	prog.nodes.resize(h.nodes);
+	for (uint32_t i = 0; i < h.nodes; i++)
+	{
+		const DiskNode& d = nodes[i];
+		prog.nodes[i] = {NodeKind(d.kind), ValType(d.type), d.line, d.a, d.b, d.c};
+	}
+	prog.lists.assign(lists, lists + h.lists);
+	prog.inits.assign(inits, inits + h.inits);
+	prog.body = h.body;
+	prog.eliminated = h.eliminated;
+	if (!Valid(prog, h.vars))
+	{
+		return false;
+	}
+
+	//Every slot is checked to be declared once, so each gets a type
+	map<SymbolId, Variable> declared;
+	prog.vars.resize(h.vars);
+	for (uint32_t i = 0; i < h.vars; i++)
+	{
+		const DiskVar& v = vars[i];
+		Token type = Token(v.token);
+		if (!str(v.str, v.strLen) || (type != INTEGER && type != REAL && type != BOOLEAN && type != STRING))
+			return false;
+		prog.vars[i] = Intern(string_view(strings + v.str, v.strLen));
+		if (!declared.emplace(prog.vars[i], Variable{type, i}).second)
+			return false;
+	}
+	//The executors trust the types of the nodes without looking at any Value
+	if (!WellTyped(prog, declared))
+	{
+		return false;
+	}
+
+	program = std::move(prog);
+	symtab = std::move(declared);
+	if (tokens)
+	{
+		*tokens = h.tokens;
+	}
+	return true;
+}
+
+bool ProgramCache::Store(string_view source, const Program& program, const map<SymbolId, Variable>& symtab, size_t tokens) const
+{
+	string strings;
+	auto addString = [&](string_view s, uint32_t& off, uint32_t& len) {
+		off = strings.size();
+		len = s.size();
+		strings.append(s.data(), s.size());
+	};
+
+	vector<DiskConst> consts(program.consts.size());
+	for (size_t i = 0; i < consts.size(); i++)
+	{
+		const Value& v = program.consts[i];
+		DiskConst& c = consts[i];
+		memset(&c, 0, sizeof c);
+		c.type = v.GetType();
+		if (v.IsInt())
+			c.ival = v.GetInt();
+		else if (v.IsBool())
+			c.ival = v.GetBool();
+		else if (v.IsReal())
+			c.rval = v.GetReal();
+		else if (v.IsString())
+			addString(v.GetString(), c.str, c.strLen);
+	}
+
+	vector<DiskNode> nodes(program.nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const Node& n = program.nodes[i];
+		DiskNode& d = nodes[i];
+		memset(&d, 0, sizeof d);
+		d.kind = n.kind;
+		d.type = n.type;
+		d.line = n.line;
+		d.a = n.a;
+		d.b = n.b;
+		d.c = n.c;
+	}
+	vector<DiskVar> vars(program.vars.size());
+	for (size_t i = 0; i < vars.size(); i++)
+	{
+		addString(SymbolName(program.vars[i]), vars[i].str, vars[i].strLen);
+		vars[i].token = symtab.at(program.vars[i]).type;
+	}
+
+	string body;
+	auto put = [&](const void* data, size_t n) { body.append(static_cast<const char*>(data), n); };
+	put(consts.data(), consts.size() * sizeof(DiskConst));
+	put(nodes.data(), nodes.size() * sizeof(DiskNode));
+	put(program.lists.data(), program.lists.size() * sizeof(uint32_t));
+	put(program.inits.data(), program.inits.size() * sizeof(uint32_t));
+	put(vars.data(), vars.size() * sizeof(DiskVar));
+	put(strings.data(), strings.size());
+
+	DiskHeader h;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, CACHE_MAGIC, sizeof h.magic);
+	h.version = CACHE_VERSION;
+	h.byteOrder = ENDIAN_MARK;
+	h.sourceHash = Hash64(source.data(), source.size());
+	h.sourceSize = source.size();
+	h.checksum = Hash64(body.data(), body.size());
+	h.tokens = tokens;
+	h.consts = consts.size();
+	h.nodes = nodes.size();
+	h.lists = program.lists.size();
+	h.inits = program.inits.size();
+	h.vars = vars.size();
+	h.stringBytes = strings.size();
+	h.body = program.body;
+	h.eliminated = program.eliminated;
+
+	//Written under a private name and renamed into place, so a reader
+	//never sees half an entry even with several writers, in this process
+	//or in others sharing the directory
+	string path = PathFor(h.sourceHash);
+	ostringstream tmpname;
+	tmpname << path << ".tmp" << getpid() << '.' << this_thread::get_id();
+	string tmp = tmpname.str();
+	{
+		ofstream out(tmp, ios::binary | ios::trunc);
+		out.write(reinterpret_cast<const char*>(&h), sizeof h);
+		out.write(body.data(), body.size());
+		out.write(source.data(), source.size());
+		if (!out)
+		{
+			out.close();
+			remove(tmp.c_str());
+			return false;
+		}
+	}
+	error_code ec;
+	filesystem::rename(tmp, path, ec);
+	if (ec)
+	{
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool CompileProgram(Interpreter& ctx, string_view source, Program& program, const ProgramCache* cache, size_t* tokens)
+{
+	if (cache && cache->Load(source, program, ctx.SymTable, tokens))
+	{
+		return true;
+	}
+
+	TokenStream toks;
+	toks.Load(string(source));
+	if (tokens)
+	{
+		*tokens = toks.Size();
+	}
+	TokenCursor cursor(toks);
+	int line = 1;
+	if (!ParseProg(ctx, cursor, line, program))
+	{
+		return false;
+	}
+	Optimize(program);
+	//An empty program ended itself while parsing, after writing output
+	//that a cache hit would not reproduce
+	if (cache && program.body != NONODE)
+	{
+		cache->Store(source, program, ctx.SymTable, toks.Size());
+	}
+	return true;
+}
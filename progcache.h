@@ -0,0 +1,37 @@
+#ifndef PROGCACHE_H_
+#define PROGCACHE_H_
+
+#include <string>
+#include <string_view>
+#include <map>
+
+using namespace std;
+
+#include "parserInterp.h"
+
+//Directory of compiled programs, one file per program named after a hash
+//of its source. An entry holds the typed program tree, the declared types
+//and the source itself in a fixed binary layout that is read straight from
+//a mapping of the file.
+//Entries written by another format version or byte order, for another
+//source, even one with the same hash, or damaged in any way, including a
+//tree that is not well typed, are ignored and rewritten.
+class ProgramCache {
+	string	dir;
+
+	string	PathFor(uint64_t hash) const;
+
+public:
+	explicit ProgramCache(string dir);		//created if missing
+
+	//Fills program and symtab from the entry for source; false on a miss
+	bool	Load(string_view source, Program& program, map<SymbolId, Variable>& symtab, size_t* tokens = nullptr) const;
+	bool	Store(string_view source, const Program& program, const map<SymbolId, Variable>& symtab, size_t tokens = 0) const;
+};
+
+//Parses and optimizes source into program, or loads it from cache when
+//that holds a valid entry; successful parses are added to the cache. tokens, if given,
+//receives the number of tokens in the program
+extern bool CompileProgram(Interpreter& ctx, string_view source, Program& program, const ProgramCache* cache, size_t* tokens = nullptr);
+
+#endif /* PROGCACHE_H_ */
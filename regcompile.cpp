@@ -0,0 +1,499 @@
+/*
+Description: Compiles a typed program tree for the register machine of
+	regvm.cpp. Operators read variables and constants straight from their
+	registers and write their result to a temporary, or to the assigned
+	variable itself when they compute the whole right-hand side, so an
+	assignment like x := x * 2 + y is two instructions. Temporaries are
+	numbered freely while compiling, then packed into as few registers as
+	their lifetimes allow by a linear scan. Whether a variable has been
+	assigned is tracked at runtime only where the program's control flow
+	does not settle it.
+*/
+
+#include "parserInterp.h"
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+//While compiling, an operand is a register class in the top two bits and
+//an index within the class; the classes are laid out in this order
+const uint32_t VAR = 0u << 30, CONST = 1u << 30, STR = 2u << 30, TEMP = 3u << 30;
+const uint32_t CLASS = 3u << 30, INDEX = ~CLASS;
+
+//Whether op writes register d
+bool Defines(RegCode op)
+{
+	return op <= R_GT_R && op != R_CHECK && op != R_MARK;
+}
+
+//How many of a and b are registers
+int Operands(RegCode op)
+{
+	if (op >= R_ADD_I && op <= R_GT_R)
+		return 2;
+	if (op == R_JUMP || op == R_WRITELN || op == R_HALT)
+		return 0;
+	return 1;
+}
+
+//Opcode for each type of value, in ValType order
+RegCode Typed(ValType t, RegCode i, RegCode r, RegCode s, RegCode b)
+{
+	switch (t)
+	{
+	case VINT:	return i;
+	case VREAL:	return r;
+	case VSTRING:	return s;
+	default:	return b;
+	}
+}
+
+//One step of compiling an expression: the subtree at node, or once its
+//operands are compiled, the node itself. And and or take a step between
+//their operands
+struct Task {
+	NodeId	node;
+	uint8_t	operandsDone;
+};
+
+//Where an and or or is between its operands: the temporary holding its
+//result, the jump over its right operand, and the variables known
+//assigned before the right operand, which may not run
+struct ShortCircuit {
+	uint32_t	result;
+	uint32_t	jump;
+	vector<bool>	definite;
+};
+
+struct RegCompiler {
+	const Program&	prog;
+	RegChunk&	chunk;
+	vector<bool>	definite;	//variables assigned on every path to here
+	uint32_t	temps = 0;
+	unordered_map<uint64_t, uint32_t>	constIndex[3];	//by VINT, VREAL, VBOOL and bits
+	vector<Task>	work;
+	vector<uint32_t>	values;	//operands of the nodes pending in work
+	vector<ShortCircuit>	shortCircuits;	//and and or nodes pending in work
+	uint32_t	target = 0;	//the last jump target
+
+	RegCompiler(const Program& prog, RegChunk& chunk) : prog(prog), chunk(chunk), definite(prog.vars.size()) {}
+
+	void Emit(RegCode op, int line, uint32_t d = 0, uint32_t a = 0, uint32_t b = 0);
+	uint32_t Temp() { return TEMP | temps++; }
+	uint32_t Constant(const Value& v);
+	uint32_t Convert(RegCode op, int line, uint32_t operand);
+	uint32_t Expr(NodeId id);
+	void Move(uint32_t d, uint32_t operand, int line);
+	void Assign(uint32_t slot, uint32_t operand, int line);
+	void Patch(uint32_t jump);
+	void Stmt(NodeId id);
+	void Allocate();
+	uint32_t Here() const { return chunk.code.size(); }
+};
+
+void RegCompiler::Emit(RegCode op, int line, uint32_t d, uint32_t a, uint32_t b)
+{
+	if (chunk.lines.empty() || chunk.lines.back().line != line)
+	{
+		chunk.lines.push_back({Here(), line});
+	}
+	chunk.code.push_back({op, d, a, b});
+}
+
+//The register holding constant v; equal constants share one
+uint32_t RegCompiler::Constant(const Value& v)
+{
+	if (v.IsString())
+	{
+		chunk.strings.push_back(v);
+		return STR | (chunk.strings.size() - 1);
+	}
+	Cell c;
+	uint64_t bits = 0;
+	int kind;
+	switch (v.GetType())
+	{
+	case VINT:	c.i = v.GetInt();	bits = (uint32_t)c.i;	kind = 0;	break;
+	case VREAL:	c.r = v.GetReal();	memcpy(&bits, &c.r, sizeof bits);	kind = 1;	break;
+	default:	c.b = v.GetBool();	bits = c.b;	kind = 2;	break;
+	}
+	auto found = constIndex[kind].emplace(bits, chunk.consts.size());
+	if (found.second)
+	{
+		chunk.consts.push_back(c);
+	}
+	return CONST | found.first->second;
+}
+
+uint32_t RegCompiler::Convert(RegCode op, int line, uint32_t operand)
+{
+	uint32_t t = Temp();
+	Emit(op, line, t, operand);
+	return t;
+}
+
+//Compiles expression id and returns the register holding its value. The
+//work list stands in for recursion, so a long chain of operators compiles
+//in constant native stack
+uint32_t RegCompiler::Expr(NodeId id)
+{
+	work.push_back({id, 0});
+	while (!work.empty())
+	{
+		Task t = work.back();
+		work.pop_back();
+		const Node& n = prog[t.node];
+
+		if (n.kind == N_CONST)
+		{
+			values.push_back(Constant(prog.consts[n.a]));
+			continue;
+		}
+		if (n.kind == N_VAR)
+		{
+			//A failed check ends the program, so later reads need none
+			if (!definite[n.a])
+			{
+				Emit(R_CHECK, n.line, 0, VAR | n.a);
+				definite[n.a] = true;
+			}
+			values.push_back(VAR | n.a);
+			continue;
+		}
+		if (n.kind == N_AND || n.kind == N_OR)
+		{
+			//The result is the left operand when that decides it, jumping
+			//over the right operand, else the right operand
+			if (t.operandsDone == 0)
+			{
+				work.push_back({t.node, 1});
+				work.push_back({n.a, 0});
+			}
+			else if (t.operandsDone == 1)
+			{
+				uint32_t result = Temp();
+				Move(result, values.back(), n.line);
+				values.pop_back();
+				shortCircuits.push_back({result, Here(), definite});
+				Emit(n.kind == N_AND ? R_JUMP_FALSE : R_JUMP_TRUE, n.line, 0, result);
+				work.push_back({t.node, 2});
+				work.push_back({n.b, 0});
+			}
+			else
+			{
+				ShortCircuit& s = shortCircuits.back();
+				Move(s.result, values.back(), n.line);
+				values.back() = s.result;
+				Patch(s.jump);
+				definite = std::move(s.definite);
+				shortCircuits.pop_back();
+			}
+			continue;
+		}
+
+		bool binary = n.kind >= N_ADD && n.kind <= N_GTHAN;
+		if (!t.operandsDone)
+		{
+			work.push_back({t.node, 1});
+			if (binary)
+				work.push_back({n.b, 0});
+			work.push_back({n.a, 0});
+			continue;
+		}
+
+		if (!binary)
+		{
+			uint32_t a = values.back();
+			values.pop_back();
+			RegCode op = n.kind == N_NOT ? R_NOT : n.type == VINT ? R_NEG_I : R_NEG_R;
+			values.push_back(Convert(op, n.line, a));
+			continue;
+		}
+
+		uint32_t b = values.back();
+		values.pop_back();
+		uint32_t a = values.back();
+		values.pop_back();
+		ValType l = prog[n.a].type, r = prog[n.b].type;
+		//The conversions an operand of type t needs to become a real
+		auto widen = [&](ValType t, uint32_t operand, RegCode conv) { return t == VINT ? Convert(conv, n.line, operand) : operand; };
+		RegCode op = R_HALT;
+		switch (n.kind)
+		{
+		case N_ADD:
+		case N_SUB:
+		case N_MUL:
+		{
+			static const RegCode ints[] = {R_ADD_I, R_SUB_I, R_MUL_I}, reals[] = {R_ADD_R, R_SUB_R, R_MUL_R};
+			int k = n.kind - N_ADD;
+			if (n.type == VINT)
+			{
+				op = ints[k];
+			}
+			else
+			{
+				op = reals[k];
+				a = widen(l, a, R_I2F);
+				b = widen(r, b, R_I2F);
+			}
+			break;
+		}
+		case N_DIV:
+		case N_IDIV:
+			//The dividend is truncated; the divisor's type is the result's
+			op = r == VINT ? R_DIV_I : R_DIV_IR;
+			if (l == VREAL)
+				a = Convert(R_R2I, n.line, a);
+			break;
+		case N_MOD:
+			op = R_MOD_I;
+			break;
+		case N_EQ:
+			if (l != r)
+			{
+				op = R_EQ_R;
+				a = widen(l, a, R_I2F);
+				b = widen(r, b, R_I2F);
+			}
+			else
+			{
+				op = Typed(l, R_EQ_I, R_EQ_R, R_EQ_S, R_EQ_B);
+			}
+			break;
+		case N_LTHAN:
+		case N_GTHAN:
+			if (l == VINT && r == VINT)
+			{
+				op = n.kind == N_LTHAN ? R_LT_I : R_GT_I;
+			}
+			else
+			{
+				op = n.kind == N_LTHAN ? R_LT_R : R_GT_R;
+				a = widen(l, a, R_I2R);
+				b = widen(r, b, R_I2R);
+			}
+			break;
+		default:
+			break;
+		}
+		uint32_t d = Temp();
+		Emit(op, n.line, d, a, b);
+		values.push_back(d);
+	}
+	uint32_t result = values.back();
+	values.pop_back();
+	return result;
+}
+
+//Copies operand to register d. When operand is the temporary the last
+//instruction computed, and no jump lands after that instruction, it
+//writes d instead
+void RegCompiler::Move(uint32_t d, uint32_t operand, int line)
+{
+	if ((operand & CLASS) == TEMP && target != Here() && Defines(chunk.code.back().op) && chunk.code.back().d == operand)
+		chunk.code.back().d = d;
+	else
+		Emit(R_MOVE, line, d, operand);
+}
+
+//Points the jump at pc jump to the next instruction
+void RegCompiler::Patch(uint32_t jump)
+{
+	target = Here();
+	chunk.code[jump].d = target;
+}
+
+//Stores operand in variable slot
+void RegCompiler::Assign(uint32_t slot, uint32_t operand, int line)
+{
+	Move(VAR | slot, operand, line);
+	if (!definite[slot])
+	{
+		Emit(R_MARK, line, 0, VAR | slot);
+		definite[slot] = true;
+	}
+}
+
+void RegCompiler::Stmt(NodeId id)
+{
+	const Node& n = prog[id];
+	switch (n.kind)
+	{
+	case N_ASSIGN:
+	case N_INIT:
+	{
+		NodeId expr = n.kind == N_ASSIGN ? n.b : n.c;
+		uint32_t value = Expr(expr);
+		if (n.type == VREAL && prog[expr].type == VINT)
+		{
+			value = Convert(R_I2R, n.line, value);
+		}
+		if (n.kind == N_ASSIGN)
+		{
+			Assign(n.a, value, n.line);
+			break;
+		}
+		const uint32_t* slots = prog.List(n);
+		Assign(slots[0], value, n.line);
+		for (uint32_t k = 1; k < n.b; k++)
+		{
+			Assign(slots[k], VAR | slots[0], n.line);
+		}
+		break;
+	}
+
+	case N_WRITE:
+	case N_WRITELN:
+	{
+		const uint32_t* exprs = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			uint32_t value = Expr(exprs[k]);
+			Emit(Typed(prog[exprs[k]].type, R_WRITE_I, R_WRITE_R, R_WRITE_S, R_WRITE_B), n.line, 0, value);
+		}
+		if (n.kind == N_WRITELN)
+		{
+			Emit(R_WRITELN, n.line);
+		}
+		break;
+	}
+
+	case N_IF:
+	{
+		uint32_t cond = Expr(n.a);
+		uint32_t skipThen = Here();
+		Emit(R_JUMP_FALSE, n.line, 0, cond);
+		vector<bool> before = definite;
+		Stmt(n.b);
+		if (n.c != NONODE)
+		{
+			uint32_t skipElse = Here();
+			Emit(R_JUMP, n.line);
+			Patch(skipThen);
+			vector<bool> afterThen = std::move(definite);
+			definite = std::move(before);
+			Stmt(n.c);
+			Patch(skipElse);
+			for (size_t k = 0; k < definite.size(); k++)
+			{
+				definite[k] = definite[k] && afterThen[k];
+			}
+		}
+		else
+		{
+			Patch(skipThen);
+			definite = std::move(before);
+		}
+		break;
+	}
+
+	case N_BLOCK:
+	{
+		const uint32_t* stmts = prog.List(n);
+		for (uint32_t k = 0; k < n.b; k++)
+		{
+			Stmt(stmts[k]);
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+//Gives every temporary a register by linear scan over their lifetimes,
+//from the instruction writing one to the last reading it, then replaces
+//every operand by its register number
+void RegCompiler::Allocate()
+{
+	vector<uint32_t> start(temps, UINT32_MAX), end(temps, 0);
+	for (uint32_t pc = 0; pc < chunk.code.size(); pc++)
+	{
+		const RegInstr& in = chunk.code[pc];
+		//The result of an and or or is written on both paths; it lives
+		//from the first
+		if (Defines(in.op) && (in.d & CLASS) == TEMP && start[in.d & INDEX] == UINT32_MAX)
+		{
+			start[in.d & INDEX] = pc;
+		}
+		int operands = Operands(in.op);
+		if (operands >= 1 && (in.a & CLASS) == TEMP)
+		{
+			end[in.a & INDEX] = pc;
+		}
+		if (operands == 2 && (in.b & CLASS) == TEMP)
+		{
+			end[in.b & INDEX] = pc;
+		}
+	}
+
+	//Temporaries are numbered in the order they are written. Every
+	//instruction reads its operands before writing, so a register whose
+	//last reader writes another temporary can hold that one
+	vector<uint32_t> reg(temps);
+	vector<uint32_t> free;
+	uint32_t used = 0;
+	typedef pair<uint32_t, uint32_t> Active;	//end, register
+	priority_queue<Active, vector<Active>, greater<Active>> active;
+	for (uint32_t t = 0; t < temps; t++)
+	{
+		if (start[t] == UINT32_MAX)
+		{
+			continue;	//replaced by a variable in Assign
+		}
+		while (!active.empty() && active.top().first <= start[t])
+		{
+			free.push_back(active.top().second);
+			active.pop();
+		}
+		if (free.empty())
+		{
+			free.push_back(used++);
+		}
+		reg[t] = free.back();
+		free.pop_back();
+		active.push({max(end[t], start[t]), reg[t]});
+	}
+
+	uint32_t base[4] = {0, chunk.vars, uint32_t(chunk.vars + chunk.consts.size()), uint32_t(chunk.vars + chunk.consts.size() + chunk.strings.size())};
+	auto physical = [&](uint32_t operand) {
+		uint32_t i = operand & INDEX;
+		return base[operand >> 30] + ((operand & CLASS) == TEMP ? reg[i] : i);
+	};
+	for (RegInstr& in : chunk.code)
+	{
+		if (Defines(in.op))
+			in.d = physical(in.d);
+		int operands = Operands(in.op);
+		if (operands >= 1)
+			in.a = physical(in.a);
+		if (operands == 2)
+			in.b = physical(in.b);
+	}
+	chunk.registers = base[3] + used;
+}
+
+}
+
+// Compiles program, which must have passed TypeCheck, for the register
+// machine: the declarations in order, then the main compound statement
+void CompileRegisters(const Program& program, RegChunk& chunk)
+{
+	chunk = RegChunk();
+	chunk.vars = program.vars.size();
+	chunk.code.reserve(program.nodes.size());
+	RegCompiler c(program, chunk);
+	for (NodeId init : program.inits)
+	{
+		c.Stmt(init);
+	}
+	if (program.body != NONODE)
+	{
+		c.Stmt(program.body);
+	}
+	c.Emit(R_HALT, 0);
+	c.Allocate();
+}
@@ -0,0 +1,227 @@
+/*
+Description: The register machine running code from regcompile.cpp,
+	dispatched like the stack machine of vm.cpp. The registers are a single
+	array of cells holding the variables, the constants and the
+	temporaries. A string register points at the constant it holds, since
+	no operator makes new strings. Only variables the compiler could not
+	prove assigned have a flag, set by R_MARK and tested by R_CHECK.
+*/
+
+#include "parserInterp.h"
+#include <climits>
+
+#if defined(__GNUC__) && !defined(VM_SWITCH)
+#define VM_COMPUTED_GOTO
+#endif
+
+// Runs chunk, writing to ctx.out. The first runtime error, an
+// uninitialized variable, a division by zero or INT_MIN divided by -1, is
+// reported through ParseError and stops the program; returns whether it
+// ran to the end
+bool ExecuteRegisters(Interpreter& ctx, const RegChunk& chunk)
+{
+	vector<Cell> registers(chunk.registers);
+	Cell* R = registers.data();
+	copy(chunk.consts.begin(), chunk.consts.end(), R + chunk.vars);
+	Cell* strings = R + chunk.vars + chunk.consts.size();
+	for (size_t k = 0; k < chunk.strings.size(); k++)
+	{
+		strings[k].s = &chunk.strings[k];
+	}
+	vector<bool> assigned(chunk.vars);
+
+	const RegInstr* code = chunk.code.data();
+	const RegInstr* pc = code;
+	ostream& out = ctx.out;
+
+#ifdef VM_COMPUTED_GOTO
+#define OPCODE_LABEL(op) &&L_##op,
+	static void* const labels[R_COUNT] = { REGCODES(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+#define TARGET(op) L_##op
+#define DISPATCH() goto *labels[pc->op]
+	DISPATCH();
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+	for (;;)
+	{
+	switch (pc->op)
+	{
+#endif
+
+	TARGET(R_MOVE):
+		R[pc->d] = R[pc->a];
+		pc++;
+		DISPATCH();
+	TARGET(R_CHECK):
+		if (!assigned[pc->a])
+			goto uninitialized;
+		pc++;
+		DISPATCH();
+	TARGET(R_MARK):
+		assigned[pc->a] = true;
+		pc++;
+		DISPATCH();
+
+	TARGET(R_I2R):
+		R[pc->d].r = R[pc->a].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_I2F):
+		R[pc->d].r = (float)R[pc->a].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_R2I):
+		R[pc->d].i = (int)R[pc->a].r;
+		pc++;
+		DISPATCH();
+
+	TARGET(R_NEG_I):
+		R[pc->d].i = -R[pc->a].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_NEG_R):
+		R[pc->d].r = -R[pc->a].r;
+		pc++;
+		DISPATCH();
+	TARGET(R_NOT):
+		R[pc->d].b = !R[pc->a].b;
+		pc++;
+		DISPATCH();
+
+	TARGET(R_ADD_I):
+		R[pc->d].i = R[pc->a].i + R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_SUB_I):
+		R[pc->d].i = R[pc->a].i - R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_MUL_I):
+		R[pc->d].i = R[pc->a].i * R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_DIV_I):
+		if (R[pc->b].i == 0)
+			goto divisionByZero;
+		if (R[pc->b].i == -1 && R[pc->a].i == INT_MIN)
+			goto divisionOverflow;
+		R[pc->d].i = R[pc->a].i / R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_MOD_I):
+		if (R[pc->b].i == 0)
+			goto divisionByZero;
+		if (R[pc->b].i == -1 && R[pc->a].i == INT_MIN)
+			goto divisionOverflow;
+		R[pc->d].i = R[pc->a].i % R[pc->b].i;
+		pc++;
+		DISPATCH();
+
+	TARGET(R_ADD_R):
+		R[pc->d].r = R[pc->a].r + R[pc->b].r;
+		pc++;
+		DISPATCH();
+	TARGET(R_SUB_R):
+		R[pc->d].r = R[pc->a].r - R[pc->b].r;
+		pc++;
+		DISPATCH();
+	TARGET(R_MUL_R):
+		R[pc->d].r = R[pc->a].r * R[pc->b].r;
+		pc++;
+		DISPATCH();
+	TARGET(R_DIV_IR):
+		if (R[pc->b].r == 0)
+			goto divisionByZero;
+		R[pc->d].r = R[pc->a].i / R[pc->b].r;
+		pc++;
+		DISPATCH();
+
+	TARGET(R_EQ_I):
+		R[pc->d].b = R[pc->a].i == R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_EQ_R):
+		R[pc->d].b = R[pc->a].r == R[pc->b].r;
+		pc++;
+		DISPATCH();
+	TARGET(R_EQ_B):
+		R[pc->d].b = R[pc->a].b == R[pc->b].b;
+		pc++;
+		DISPATCH();
+	TARGET(R_EQ_S):
+		R[pc->d].b = R[pc->a].s->GetString() == R[pc->b].s->GetString();
+		pc++;
+		DISPATCH();
+	TARGET(R_LT_I):
+		R[pc->d].b = R[pc->a].i < R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_GT_I):
+		R[pc->d].b = R[pc->a].i > R[pc->b].i;
+		pc++;
+		DISPATCH();
+	TARGET(R_LT_R):
+		R[pc->d].b = R[pc->a].r < R[pc->b].r;
+		pc++;
+		DISPATCH();
+	TARGET(R_GT_R):
+		R[pc->d].b = R[pc->a].r > R[pc->b].r;
+		pc++;
+		DISPATCH();
+
+	TARGET(R_JUMP):
+		pc = code + pc->d;
+		DISPATCH();
+	TARGET(R_JUMP_FALSE):
+		pc = R[pc->a].b ? pc + 1 : code + pc->d;
+		DISPATCH();
+	TARGET(R_JUMP_TRUE):
+		pc = R[pc->a].b ? code + pc->d : pc + 1;
+		DISPATCH();
+
+	//Written as the Value they stand for, for the same formatting
+	TARGET(R_WRITE_I):
+		out << Value(R[pc->a].i);
+		pc++;
+		DISPATCH();
+	TARGET(R_WRITE_R):
+		out << Value(R[pc->a].r);
+		pc++;
+		DISPATCH();
+	TARGET(R_WRITE_B):
+		out << Value(R[pc->a].b);
+		pc++;
+		DISPATCH();
+	TARGET(R_WRITE_S):
+		out << *R[pc->a].s;
+		pc++;
+		DISPATCH();
+	TARGET(R_WRITELN):
+		out << "\n";
+		pc++;
+		DISPATCH();
+
+	TARGET(R_HALT):
+		return true;
+
+#ifndef VM_COMPUTED_GOTO
+	default:
+		return true;
+	}
+	}
+#endif
+#undef TARGET
+#undef DISPATCH
+
+uninitialized:
+	ParseError(ctx, chunk.Line(pc - code), "Using uninitialzied variable");
+	return false;
+divisionByZero:
+	ParseError(ctx, chunk.Line(pc - code), "Illegal division by zero");
+	return false;
+divisionOverflow:
+	ParseError(ctx, chunk.Line(pc - code), "Integer division overflow");
+	return false;
+}
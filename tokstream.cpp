@@ -0,0 +1,308 @@
+/*
+Description: Lexes a program once into a TokenStream, sequentially or in
+	parallel chunks
+*/
+
+#include "tokstream.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+bool TokenStream::Open(const char* filename, int linenum, unsigned threads)
+{
+	if (!source.Open(filename))
+	{
+		return false;
+	}
+	Lex(linenum, threads);
+	return true;
+}
+
+void TokenStream::Load(istream& in, int linenum, unsigned threads)
+{
+	source.Load(in);
+	Lex(linenum, threads);
+}
+
+void TokenStream::Load(string src, int linenum, unsigned threads)
+{
+	source.Load(std::move(src));
+	Lex(linenum, threads);
+}
+
+//Below this many bytes per chunk, starting threads costs more than it saves
+static const size_t MIN_CHUNK = 256 * 1024;
+
+void TokenStream::Lex(int linenum, unsigned threads)
+{
+	kind.clear();
+	line.clear();
+	offset.clear();
+	length.clear();
+	sym.clear();
+
+	size_t size = source.End() - source.Begin();
+	if (threads > 1 && size / threads >= MIN_CHUNK)
+	{
+		LexParallel(linenum, threads);
+		return;
+	}
+
+	//Roughly one token per six bytes of source
+	size_t guess = size / 6 + 1;
+	kind.reserve(guess);
+	line.reserve(guess);
+	offset.reserve(guess);
+	length.reserve(guess);
+	sym.reserve(guess);
+
+	while (true)
+	{
+		LexItem t = getNextToken(source, linenum);
+		string_view lexeme = t.GetLexeme();
+		kind.push_back(t.GetToken());
+		line.push_back(t.GetLinenum());
+		offset.push_back(lexeme.empty() ? 0 : lexeme.data() - source.Begin());
+		length.push_back(lexeme.size());
+		sym.push_back(t.GetSymbol());
+		if (t == DONE || t == ERR)
+		{
+			break;
+		}
+	}
+}
+
+// Parallel lexing
+//
+// The source is cut just after newlines. Tokens never span a newline and a
+// string constant always ends at one, so a cut can only be wrong when it
+// falls inside a { } comment. Each chunk is lexed on its own thread assuming
+// it starts outside a comment; while stitching, a chunk that ends inside an
+// open comment makes the next chunk be lexed again from that comment's {.
+
+namespace {
+
+//Tokens of one chunk, with line numbers counted from the chunk start
+struct Piece {
+	const char*	begin;
+	const char*	end;
+	vector<unsigned char>	kind;
+	vector<int>	line;
+	vector<uint32_t>	offset;
+	vector<uint32_t>	length;
+	vector<SymbolId>	sym;
+	int	lines = 0;			//newlines in the chunk
+	const char*	openComment = nullptr;	//the { of a comment still open at the chunk end
+	bool	stopped = false;		//ended at an ERR token
+};
+
+void LexPiece(const char* base, const char* begin, const char* end, bool last, Piece& p)
+{
+	LexBuffer chunk;
+	chunk.Borrow(begin, end);
+	p.begin = begin;
+	p.end = end;
+
+	int linenum = 0;
+	while (true)
+	{
+		LexItem t = getNextToken(chunk, linenum);
+		string_view lexeme = t.GetLexeme();
+		if (t == DONE)
+		{
+			break;
+		}
+		if (t == ERR && !last && lexeme.size() > 0 && lexeme[0] == '{' && lexeme.data() + lexeme.size() == end)
+		{
+			p.openComment = lexeme.data();
+			break;
+		}
+		p.kind.push_back(t.GetToken());
+		p.line.push_back(t.GetLinenum());
+		p.offset.push_back(lexeme.empty() ? 0 : lexeme.data() - base);
+		p.length.push_back(lexeme.size());
+		p.sym.push_back(t.GetSymbol());
+		if (t == ERR)
+		{
+			p.stopped = true;
+			break;
+		}
+	}
+	p.lines = linenum;
+}
+
+}
+
+void TokenStream::LexParallel(int linenum, unsigned threads)
+{
+	const char* base = source.Begin();
+	const char* end = source.End();
+	size_t size = end - base;
+
+	//Cut points just past the first newline after each even split
+	vector<const char*> cuts{base};
+	for (unsigned k = 1; k < threads; k++)
+	{
+		const char* target = base + size / threads * k;
+		if (target <= cuts.back())
+		{
+			continue;
+		}
+		const void* nl = memchr(target, '\n', end - target);
+		if (!nl)
+		{
+			break;
+		}
+		cuts.push_back(static_cast<const char*>(nl) + 1);
+	}
+	cuts.push_back(end);
+
+	size_t npieces = cuts.size() - 1;
+	vector<Piece> pieces(npieces);
+	vector<thread> workers;
+	for (size_t k = 1; k < npieces; k++)
+	{
+		workers.emplace_back(LexPiece, base, cuts[k], cuts[k + 1], k + 1 == npieces, std::ref(pieces[k]));
+	}
+	LexPiece(base, cuts[0], cuts[1], npieces == 1, pieces[0]);
+	for (thread& w : workers)
+	{
+		w.join();
+	}
+
+	size_t total = 1;
+	for (const Piece& p : pieces)
+	{
+		total += p.kind.size();
+	}
+	kind.reserve(total);
+	line.reserve(total);
+	offset.reserve(total);
+	length.reserve(total);
+	sym.reserve(total);
+
+	//Stitch in order, relexing after any chunk that ended inside a comment
+	int lineBase = linenum;
+	for (size_t k = 0; k < npieces; k++)
+	{
+		Piece* p = &pieces[k];
+		Piece redo;
+		if (k > 0 && pieces[k - 1].openComment)
+		{
+			const Piece& prev = pieces[k - 1];
+			lineBase = lineBase - prev.lines + count(prev.begin, prev.openComment, '\n');
+			LexPiece(base, prev.openComment, p->end, k + 1 == npieces, redo);
+			pieces[k].openComment = redo.openComment;
+			pieces[k].begin = redo.begin;
+			pieces[k].lines = redo.lines;
+			p = &redo;
+		}
+
+		kind.insert(kind.end(), p->kind.begin(), p->kind.end());
+		offset.insert(offset.end(), p->offset.begin(), p->offset.end());
+		length.insert(length.end(), p->length.begin(), p->length.end());
+		sym.insert(sym.end(), p->sym.begin(), p->sym.end());
+		for (int l : p->line)
+		{
+			line.push_back(l + lineBase);
+		}
+		lineBase += p->lines;
+
+		if (p->stopped)
+		{
+			return;
+		}
+	}
+
+	kind.push_back(DONE);
+	line.push_back(lineBase);
+	offset.push_back(0);
+	length.push_back(0);
+	sym.push_back(NOSYM);
+}
+
+// Streaming
+
+void StreamLexer::Emit(const LexItem& tok)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		tokens.push_back(tok);
+	}
+	ready.notify_all();
+	stopped = (tok == DONE || tok == ERR);
+}
+
+void StreamLexer::Feed(const char* data, size_t n)
+{
+	if (stopped || n == 0)
+	{
+		return;
+	}
+	chunks.emplace_back(data, n);
+	const char* p = chunks.back().data();
+	const char* end = p + n;
+
+	while (!stopped)
+	{
+		//A token carried over from the previous chunk starts in partial
+		const char* chunkStart = p;
+		const char* lexstart = state.InToken() ? nullptr : p;
+		bool ended = ScanToken(state, p, end, lexstart, linenum);
+
+		string_view lexeme;
+		if (lexstart)
+		{
+			partial.clear();
+			lexeme = string_view(lexstart, p - lexstart);
+		}
+		else
+		{
+			partial.append(chunkStart, p - chunkStart);
+		}
+
+		if (!ended)
+		{
+			if (lexstart && state.InToken())
+			{
+				partial.assign(lexeme.data(), lexeme.size());
+			}
+			return;
+		}
+
+		if (!lexstart)
+		{
+			chunks.push_back(std::move(partial));
+			partial.clear();
+			lexeme = chunks.back();
+		}
+		Emit(MakeToken(state, lexeme, linenum));
+		state = LexState();
+	}
+}
+
+void StreamLexer::Finish()
+{
+	if (stopped)
+	{
+		return;
+	}
+	if (state.InToken())
+	{
+		chunks.push_back(std::move(partial));
+		partial.clear();
+		Emit(MakeToken(state, chunks.back(), linenum));
+		state = LexState();
+	}
+	if (!stopped)
+	{
+		Emit(LexItem(DONE, "", linenum));
+	}
+}
+
+LexItem StreamLexer::Get(size_t i) const
+{
+	unique_lock<mutex> guard(lock);
+	ready.wait(guard, [&] { return i < tokens.size() || (!tokens.empty() && (tokens.back() == DONE || tokens.back() == ERR)); });
+	return tokens[i < tokens.size() ? i : tokens.size() - 1];
+}
@@ -0,0 +1,103 @@
+#ifndef TOKSTREAM_H_
+#define TOKSTREAM_H_
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "lex.h"
+
+using namespace std;
+
+//A whole program lexed once into parallel arrays. It owns its source
+//text, so it can be kept and parsed again without re-lexing
+class TokenStream {
+	LexBuffer	source;
+	vector<unsigned char>	kind;
+	vector<int>	line;
+	vector<uint32_t>	offset;
+	vector<uint32_t>	length;
+	vector<SymbolId>	sym;
+
+	void	Lex(int linenum, unsigned threads);
+	void	LexParallel(int linenum, unsigned threads);
+
+public:
+	//threads > 1 lexes large sources in that many chunks at once; the
+	//result is identical to lexing sequentially
+	bool	Open(const char* filename, int linenum = 1, unsigned threads = 1);
+	void	Load(istream& in, int linenum = 1, unsigned threads = 1);
+	void	Load(string src, int linenum = 1, unsigned threads = 1);
+
+	string_view	Text() const { return string_view(source.Begin(), source.End() - source.Begin()); }
+
+	//Tokens up to and including the terminating DONE or ERR
+	size_t	Size() const { return kind.size(); }
+	Token	Kind(size_t i) const { return Token(kind[i]); }
+	int	Line(size_t i) const { return line[i]; }
+	string_view	Lexeme(size_t i) const { return string_view(source.Begin() + offset[i], length[i]); }
+	LexItem	Get(size_t i) const { return LexItem(Kind(i), Lexeme(i), line[i], sym[i]); }
+};
+
+//Push-style lexer for programs that arrive in pieces (pipes, sockets).
+//Feed may be called with chunks cut anywhere, even inside a string, a
+//comment, := or a real constant. Tokens become available as soon as they
+//are complete, and a parser on another thread can read them through a
+//TokenCursor while the rest of the input is still arriving
+class StreamLexer {
+	deque<string>	chunks;		//every fed chunk, so lexemes stay valid
+	string	partial;		//bytes of a token cut by a chunk boundary
+	LexState	state;
+	int	linenum;
+	bool	stopped = false;	//DONE or ERR has been emitted
+
+	deque<LexItem>	tokens;
+	mutable mutex	lock;
+	mutable condition_variable	ready;
+
+	void	Emit(const LexItem& tok);
+
+public:
+	explicit StreamLexer(int linenum = 1) : linenum(linenum) {}
+
+	void	Feed(const char* data, size_t n);
+	void	Feed(string_view data) { Feed(data.data(), data.size()); }
+	void	Finish();		//end of input: flush the last token and DONE
+
+	//Token i, waiting until it has been lexed. Past the end of the
+	//input this is the final DONE (or ERR) token
+	LexItem	Get(size_t i) const;
+};
+
+//Read position in a TokenStream or a StreamLexer. Reading past the end
+//keeps returning the final DONE (or ERR) token
+class TokenCursor {
+	const TokenStream*	toks;
+	const StreamLexer*	live;
+	size_t	pos;
+
+public:
+	explicit TokenCursor(const TokenStream& toks) : toks(&toks), live(nullptr), pos(0) {}
+	explicit TokenCursor(const StreamLexer& live) : toks(nullptr), live(&live), pos(0) {}
+
+	LexItem	Next() { LexItem t = Peek(0); pos++; return t; }
+	LexItem	Peek(size_t k = 0) const {
+		size_t i = pos + k;
+		if (live)
+			return live->Get(i);
+		return toks->Get(i < toks->Size() ? i : toks->Size() - 1);
+	}
+	void	PushBack() { if (pos > 0) pos--; }
+
+	//Kind of the next token, without building a LexItem
+	Token	PeekToken() const {
+		if (live)
+			return live->Get(pos).GetToken();
+		return toks->Kind(pos < toks->Size() ? pos : toks->Size() - 1);
+	}
+
+	size_t	Mark() const { return pos; }
+	void	Rewind(size_t mark) { pos = mark; }
+};
+
+#endif /* TOKSTREAM_H_ */
@@ -0,0 +1,247 @@
+/*
+Description: Static type check of a parsed program. Every expression gets
+	the type of the Value it evaluates to, worked out from the declared
+	types of the variables and the rules of Value's operators, so that
+	exec.cpp can evaluate each node with the one operation its operand types
+	call for. Ill-typed expressions, conditions and assignments are reported
+	before anything runs.
+*/
+
+#include "parserInterp.h"
+#include <algorithm>
+
+namespace {
+
+ValType DeclaredType(Token type)
+{
+	switch (type)
+	{
+	case INTEGER:	return VINT;
+	case REAL:	return VREAL;
+	case STRING:	return VSTRING;
+	case BOOLEAN:	return VBOOL;
+	default:	return VERR;
+	}
+}
+
+bool IsNumeric(ValType t)
+{
+	return t == VINT || t == VREAL;
+}
+
+//Result of a binary operator on operands of types l and r, following
+//Value's operators (no string +, int / int is an int, ...); VERR when the
+//operator does not apply to them
+ValType BinaryType(NodeKind kind, ValType l, ValType r)
+{
+	switch (kind)
+	{
+	case N_ADD:
+	case N_SUB:
+	case N_MUL:
+		if (IsNumeric(l) && IsNumeric(r))
+			return l == VINT && r == VINT ? VINT : VREAL;
+		break;
+	case N_DIV:
+	case N_IDIV:
+		//The dividend is truncated to an integer, so the divisor decides
+		if (IsNumeric(l) && IsNumeric(r))
+			return r;
+		break;
+	case N_MOD:
+		if (l == VINT && r == VINT)
+			return VINT;
+		break;
+	case N_EQ:
+		if ((l == r && l != VERR) || (IsNumeric(l) && IsNumeric(r)))
+			return VBOOL;
+		break;
+	case N_LTHAN:
+	case N_GTHAN:
+		if (IsNumeric(l) && IsNumeric(r))
+			return VBOOL;
+		break;
+	case N_AND:
+	case N_OR:
+		if (l == VBOOL && r == VBOOL)
+			return VBOOL;
+		break;
+	default:
+		break;
+	}
+	return VERR;
+}
+
+//The messages the executor gave for these errors when it found them at
+//runtime
+const char* BinaryError(NodeKind kind)
+{
+	switch (kind)
+	{
+	case N_ADD:
+	case N_SUB:
+		return "ERROR WITH TYPING OR EVALUATING EXPRESSION";
+	case N_AND:
+		return "ERROR (LogANDExpr)";
+	case N_OR:
+		return "Incorrect operand type (Expr)";
+	case N_EQ:
+	case N_LTHAN:
+	case N_GTHAN:
+		return "Incorrect operand type (RelExpr)";
+	default:
+		return "Error (Term)";
+	}
+}
+
+//An integer may be stored in a real variable; otherwise the types match
+bool Assignable(ValType to, ValType from)
+{
+	return to == from || (to == VREAL && from == VINT);
+}
+
+struct TypeError {
+	int	line;
+	const char	*msg;
+};
+
+//Types node n, whose operands are already typed, given the declared type
+//of each slot. An expression with an operand already in error is not
+//reported again
+void TypeNode(const Program& prog, Node& n, const vector<ValType>& vars, vector<TypeError>& errors)
+{
+	const char* error = nullptr;
+	switch (n.kind)
+	{
+	case N_CONST:
+		//Typed by the parser; VERR only where a factor was missing
+		if (n.type == VERR)
+		{
+			error = "Missing operand (Factor)";
+		}
+		break;
+
+	case N_VAR:
+		n.type = vars[n.a];
+		break;
+
+	case N_NEG:
+	case N_NOT:
+	{
+		ValType t = prog.nodes[n.a].type;
+		n.type = (n.kind == N_NEG ? IsNumeric(t) : t == VBOOL) ? t : VERR;
+		if (t != VERR && n.type == VERR)
+		{
+			error = n.kind == N_NEG ? "Incorrect type for minus (Factor)" : "Incorrect type for NOT (Factor)";
+		}
+		break;
+	}
+
+	case N_ADD: case N_SUB: case N_MUL: case N_DIV: case N_IDIV: case N_MOD:
+	case N_EQ: case N_LTHAN: case N_GTHAN: case N_AND: case N_OR:
+	{
+		ValType l = prog.nodes[n.a].type, r = prog.nodes[n.b].type;
+		n.type = BinaryType(n.kind, l, r);
+		if (l != VERR && r != VERR && n.type == VERR)
+		{
+			error = BinaryError(n.kind);
+		}
+		break;
+	}
+
+	case N_ASSIGN:
+	case N_INIT:
+	{
+		//All the names of one declaration have the same type
+		uint32_t slot = n.kind == N_ASSIGN ? n.a : prog.List(n)[0];
+		ValType t = prog.nodes[n.kind == N_ASSIGN ? n.b : n.c].type;
+		n.type = vars[slot];
+		if (t != VERR && !Assignable(n.type, t))
+		{
+			error = n.kind == N_ASSIGN ? "Incorrect type for assignment (AssignStmt)" : "Incorrect type for initialization (DeclStmt)";
+		}
+		break;
+	}
+
+	case N_IF:
+	{
+		ValType t = prog.nodes[n.a].type;
+		if (t != VERR && t != VBOOL)
+		{
+			error = "Incorrect argument (Ifstmt)";
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+	if (error)
+	{
+		errors.push_back({n.line, error});
+	}
+}
+
+//The declared type of each slot
+vector<ValType> SlotTypes(const Program& program, const map<SymbolId, Variable>& symtab)
+{
+	vector<ValType> vars(program.vars.size(), VERR);
+	for (auto& v : symtab)
+	{
+		vars[v.second.slot] = DeclaredType(v.second.type);
+	}
+	return vars;
+}
+
+}
+
+// Types every expression of program and reports each ill-typed one, in
+// line order; true when there were none. The parser adds every node after
+// its operands and sub-statements, so a single pass in index order finds
+// the operands of each node typed already, however deep the tree is
+bool TypeCheck(Interpreter& ctx, Program& program)
+{
+	vector<ValType> vars = SlotTypes(program, ctx.SymTable);
+	vector<TypeError> errors;
+	for (Node& n : program.nodes)
+	{
+		TypeNode(program, n, vars, errors);
+	}
+	stable_sort(errors.begin(), errors.end(), [](const TypeError& a, const TypeError& b) { return a.line < b.line; });
+	for (const TypeError& e : errors)
+	{
+		ParseError(ctx, e.line, e.msg);
+	}
+	return errors.empty();
+}
+
+// Whether every node of program already has the type TypeCheck would give
+// it, without error, for the variables declared in symtab. For a program
+// that did not come from the parser, whose slots and node indices have
+// been checked
+bool WellTyped(const Program& program, const map<SymbolId, Variable>& symtab)
+{
+	vector<ValType> vars = SlotTypes(program, symtab);
+	vector<TypeError> errors;
+	for (const Node& n : program.nodes)
+	{
+		Node typed = n;
+		TypeNode(program, typed, vars, errors);
+		if (!errors.empty() || typed.type != n.type || (n.kind <= N_OR && n.type == VERR))
+		{
+			return false;
+		}
+		if (n.kind == N_CONST && program.consts[n.a].GetType() != n.type)
+		{
+			return false;
+		}
+		for (uint32_t k = 0; n.kind == N_INIT && k < n.b; k++)
+		{
+			if (vars[program.List(n)[k]] != n.type)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
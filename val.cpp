@@ -60,7 +60,7 @@ Value Value::operator==(const Value& op) const {
 //Overloaded && operator
 Value Value::operator&&(const Value& oper) const {
     if(GetType() == VBOOL && oper.GetType() == VBOOL){
-        return Value(GetBool() == oper.GetBool());
+        return Value(GetBool() && oper.GetBool());
     }
     return Value();
 }
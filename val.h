@@ -9,25 +9,67 @@
 #include <stdexcept>
 #include <cmath>
 #include <sstream>
+#include <cstdint>
+#include <atomic>
 
 using namespace std;
 
-enum ValType { VINT, VREAL, VSTRING, VBOOL, VERR };
+enum ValType : uint8_t { VINT, VREAL, VSTRING, VBOOL, VERR };
 
+//A value of the language: an integer, real, string or boolean, or an error.
+//The type tag and the value share 16 bytes; a string's text lives out of
+//line and is shared, reference counted, by the copies of the Value, so
+//copying any Value never copies characters.
 class Value {
+    //Text of a string Value, freed with the last Value sharing it
+    struct Text {
+        atomic<unsigned>	refs;
+        string	str;
+        explicit Text(string s) : refs(1), str(std::move(s)) {}
+    };
+
     ValType	T;
-    bool    Btemp;
-    int 	Itemp;
-	double   Rtemp;
-    string	Stemp;
+    union Payload {
+        bool	Btemp;
+        int 	Itemp;
+        double	Rtemp;
+        Text*	Stemp;
+    } P;
+
+    friend struct ValueLayout;	//for the code jit.cpp generates
+
+    void Retain() const { if (T == VSTRING) P.Stemp->refs.fetch_add(1, memory_order_relaxed); }
+    void Release() { if (T == VSTRING && P.Stemp->refs.fetch_sub(1, memory_order_acq_rel) == 1) delete P.Stemp; }
     
        
 public:
-    Value() : T(VERR), Btemp(false), Itemp(0), Rtemp(0.0), Stemp("") {}
-    Value(bool vb) : T(VBOOL), Btemp(vb), Itemp(0), Rtemp(0.0), Stemp("") {}
-    Value(int vi) : T(VINT), Btemp(false), Itemp(vi), Rtemp(0.0), Stemp("") {}
-    Value(double vr) : T(VREAL), Btemp(false), Itemp(0), Rtemp(vr), Stemp("") {}
-    Value(string vs) : T(VSTRING), Btemp(false), Itemp(0), Rtemp(0.0), Stemp(vs) {}
+    Value() : T(VERR) { P.Rtemp = 0.0; }
+    Value(bool vb) : T(VBOOL) { P.Btemp = vb; }
+    Value(int vi) : T(VINT) { P.Itemp = vi; }
+    Value(double vr) : T(VREAL) { P.Rtemp = vr; }
+    Value(string vs) : T(VSTRING) { P.Stemp = new Text(std::move(vs)); }
+
+    Value(const Value& v) : T(v.T), P(v.P) { Retain(); }
+    Value(Value&& v) noexcept : T(v.T), P(v.P) { v.T = VERR; }
+    ~Value() { Release(); }
+
+    Value& operator=(const Value& v) {
+        v.Retain();
+        Release();
+        T = v.T;
+        P = v.P;
+        return *this;
+    }
+
+    Value& operator=(Value&& v) noexcept {
+        if (this != &v) {
+            Release();
+            T = v.T;
+            P = v.P;
+            v.T = VERR;
+        }
+        return *this;
+    }
     
     
     ValType GetType() const { return T; }
@@ -37,37 +79,46 @@ public:
     bool IsBool() const {return T == VBOOL;}
     bool IsInt() const { return T == VINT; }
     
-    int GetInt() const { if( IsInt() ) return Itemp; throw "RUNTIME ERROR: Value not an integer"; }
+    int GetInt() const { if( IsInt() ) return P.Itemp; throw "RUNTIME ERROR: Value not an integer"; }
     
-    string GetString() const { if( IsString() ) return Stemp; throw "RUNTIME ERROR: Value not a string"; }
+    const string& GetString() const { if( IsString() ) return P.Stemp->str; throw "RUNTIME ERROR: Value not a string"; }
     
-    double GetReal() const { if( IsReal() ) return Rtemp; throw "RUNTIME ERROR: Value not an integer"; }
+    double GetReal() const { if( IsReal() ) return P.Rtemp; throw "RUNTIME ERROR: Value not an integer"; }
     
-    bool GetBool() const {if(IsBool()) return Btemp; throw "RUNTIME ERROR: Value not a boolean";}
+    bool GetBool() const {if(IsBool()) return P.Btemp; throw "RUNTIME ERROR: Value not a boolean";}
     
+    //The setters replace both the value and its type; SetType gives the
+    //Value the zero of the new type
     void SetType(ValType type)
     {
-    	T = type;
+    	switch (type)
+    	{
+    	case VINT:	*this = Value(0);	break;
+    	case VREAL:	*this = Value(0.0);	break;
+    	case VSTRING:	*this = Value(string());	break;
+    	case VBOOL:	*this = Value(false);	break;
+    	default:	*this = Value();	break;
+    	}
 	}
 	
 	void SetInt(int val)
     {
-    	Itemp = val;
+    	*this = Value(val);
 	}
 	
 	void SetReal(double val)
     {
-    	Rtemp = val;
+    	*this = Value(val);
 	}
 	
 	void SetString(string val)
     {
-    	Stemp = val;
+    	*this = Value(std::move(val));
 	}
 	
 	void SetBool(bool val)
     {
-    	Btemp = val;
+    	*this = Value(val);
 	}
 	
 	
@@ -108,9 +159,9 @@ public:
 	
 	    
     friend ostream& operator<<(ostream& out, const Value& op) {
-        if( op.IsInt() ) out << op.Itemp;
-		else if( op.IsString() ) out << op.Stemp ;
-        else if( op.IsReal()) out << fixed << showpoint << setprecision(2) << op.Rtemp;
+        if( op.IsInt() ) out << op.P.Itemp;
+		else if( op.IsString() ) out << op.P.Stemp->str ;
+        else if( op.IsReal()) out << fixed << showpoint << setprecision(2) << op.P.Rtemp;
         else if(op.IsBool()) out << (op.GetBool()? "true" : "false");
         else out << "ERROR";
         return out;
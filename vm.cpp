@@ -0,0 +1,354 @@
+/*
+Description: The stack machine running bytecode from compile.cpp. Each
+	instruction is dispatched with a computed goto where the compiler
+	supports labels as values (GCC and Clang), through a switch otherwise
+	or when built with -DVM_SWITCH. Variables are the Values of
+	TempsResults, by slot; a variable whose Value does not have its declared
+	type yet has never been assigned. Built with -DVM_STATS, it counts the
+	instructions it runs of each opcode in ctx.executed.
+*/
+
+#include "parserInterp.h"
+#include <climits>
+
+#if defined(__GNUC__) && !defined(VM_SWITCH)
+#define VM_COMPUTED_GOTO
+#endif
+
+// Runs chunk, writing to ctx.out. The first runtime error, an
+// uninitialized variable, a division by zero or INT_MIN divided by -1, is
+// reported through ParseError and stops the program; returns whether it
+// ran to the end
+bool ExecuteChunk(Interpreter& ctx, const Chunk& chunk)
+{
+	ctx.TempsResults.assign(chunk.vars, Value());
+	vector<Cell> stack(chunk.maxStack);
+
+	Value* vars = ctx.TempsResults.data();
+	const Cell* consts = chunk.consts.data();
+	const Value* strings = chunk.strings.data();
+	const Instr* code = chunk.code.data();
+	const Instr* pc = code;
+	Cell* sp = stack.data();	//the first free cell
+	ostream& out = ctx.out;
+
+#ifdef VM_STATS
+	ctx.executed.assign(OP_COUNT, 0);
+	uint64_t* executed = ctx.executed.data();
+#define COUNT() executed[pc->op]++
+#else
+#define COUNT()
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+#define OPCODE_LABEL(op) &&L_##op,
+	static void* const labels[OP_COUNT] = { OPCODES(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+#define TARGET(op) L_##op
+#define DISPATCH() do { COUNT(); goto *labels[pc->op]; } while (0)
+	DISPATCH();
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+	for (;;)
+	{
+	COUNT();
+	switch (pc->op)
+	{
+#endif
+
+	TARGET(OP_PUSH):
+		*sp++ = consts[pc->a];
+		pc++;
+		DISPATCH();
+	TARGET(OP_PUSH_S):
+		(sp++)->s = &strings[pc->a];
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_LOAD_I):
+		if (!vars[pc->a].IsInt())
+			goto uninitialized;
+		(sp++)->i = vars[pc->a].GetInt();
+		pc++;
+		DISPATCH();
+	TARGET(OP_LOAD_R):
+		if (!vars[pc->a].IsReal())
+			goto uninitialized;
+		(sp++)->r = vars[pc->a].GetReal();
+		pc++;
+		DISPATCH();
+	TARGET(OP_LOAD_B):
+		if (!vars[pc->a].IsBool())
+			goto uninitialized;
+		(sp++)->b = vars[pc->a].GetBool();
+		pc++;
+		DISPATCH();
+	TARGET(OP_LOAD_S):
+		if (!vars[pc->a].IsString())
+			goto uninitialized;
+		(sp++)->s = &vars[pc->a];
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_STORE_I):
+		vars[pc->a] = Value((--sp)->i);
+		pc++;
+		DISPATCH();
+	TARGET(OP_STORE_R):
+		vars[pc->a] = Value((--sp)->r);
+		pc++;
+		DISPATCH();
+	TARGET(OP_STORE_B):
+		vars[pc->a] = Value((--sp)->b);
+		pc++;
+		DISPATCH();
+	TARGET(OP_STORE_S):
+		vars[pc->a] = *(--sp)->s;
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_DUP):
+		*sp = sp[-1];
+		sp++;
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_I2R):
+		sp[-1].r = sp[-1].i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_I2F):
+		sp[-1].r = (float)sp[-1].i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_R2I):
+		sp[-1].i = (int)sp[-1].r;
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_NEG_I):
+		sp[-1].i = -sp[-1].i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_NEG_R):
+		sp[-1].r = -sp[-1].r;
+		pc++;
+		DISPATCH();
+	TARGET(OP_NOT):
+		sp[-1].b = !sp[-1].b;
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_ADD_I):
+		sp--;
+		sp[-1].i = sp[-1].i + sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_SUB_I):
+		sp--;
+		sp[-1].i = sp[-1].i - sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_MUL_I):
+		sp--;
+		sp[-1].i = sp[-1].i * sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_DIV_I):
+		sp--;
+		if (sp->i == 0)
+			goto divisionByZero;
+		if (sp->i == -1 && sp[-1].i == INT_MIN)
+			goto divisionOverflow;
+		sp[-1].i = sp[-1].i / sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_MOD_I):
+		sp--;
+		if (sp->i == 0)
+			goto divisionByZero;
+		if (sp->i == -1 && sp[-1].i == INT_MIN)
+			goto divisionOverflow;
+		sp[-1].i = sp[-1].i % sp->i;
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_ADD_R):
+		sp--;
+		sp[-1].r = sp[-1].r + sp->r;
+		pc++;
+		DISPATCH();
+	TARGET(OP_SUB_R):
+		sp--;
+		sp[-1].r = sp[-1].r - sp->r;
+		pc++;
+		DISPATCH();
+	TARGET(OP_MUL_R):
+		sp--;
+		sp[-1].r = sp[-1].r * sp->r;
+		pc++;
+		DISPATCH();
+	TARGET(OP_DIV_IR):
+		sp--;
+		if (sp->r == 0)
+			goto divisionByZero;
+		sp[-1].r = sp[-1].i / sp->r;
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_EQ_I):
+		sp--;
+		sp[-1].b = sp[-1].i == sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_EQ_R):
+		sp--;
+		sp[-1].b = sp[-1].r == sp->r;
+		pc++;
+		DISPATCH();
+	TARGET(OP_EQ_B):
+		sp--;
+		sp[-1].b = sp[-1].b == sp->b;
+		pc++;
+		DISPATCH();
+	TARGET(OP_EQ_S):
+		sp--;
+		sp[-1].b = sp[-1].s->GetString() == sp->s->GetString();
+		pc++;
+		DISPATCH();
+	TARGET(OP_LT_I):
+		sp--;
+		sp[-1].b = sp[-1].i < sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_GT_I):
+		sp--;
+		sp[-1].b = sp[-1].i > sp->i;
+		pc++;
+		DISPATCH();
+	TARGET(OP_LT_R):
+		sp--;
+		sp[-1].b = sp[-1].r < sp->r;
+		pc++;
+		DISPATCH();
+	TARGET(OP_GT_R):
+		sp--;
+		sp[-1].b = sp[-1].r > sp->r;
+		pc++;
+		DISPATCH();
+
+	//Superinstructions: the top of the stack, operator, then constant a
+	//or the variable a, which must have been assigned
+#define WITH_CONSTANT(op, result, operator, field) \
+	TARGET(op): \
+		sp[-1].result = sp[-1].field operator consts[pc->a].field; \
+		pc++; \
+		DISPATCH();
+#define WITH_VARIABLE(op, result, operator, field, is, get) \
+	TARGET(op): \
+		if (!vars[pc->a].is()) \
+			goto uninitialized; \
+		sp[-1].result = sp[-1].field operator vars[pc->a].get(); \
+		pc++; \
+		DISPATCH();
+
+	WITH_CONSTANT(OP_ADD_IC, i, +, i)
+	WITH_CONSTANT(OP_SUB_IC, i, -, i)
+	WITH_CONSTANT(OP_MUL_IC, i, *, i)
+	WITH_CONSTANT(OP_DIV_IC, i, /, i)
+	WITH_CONSTANT(OP_MOD_IC, i, %, i)
+	WITH_CONSTANT(OP_EQ_IC, b, ==, i)
+	WITH_CONSTANT(OP_LT_IC, b, <, i)
+	WITH_CONSTANT(OP_GT_IC, b, >, i)
+	WITH_CONSTANT(OP_ADD_RC, r, +, r)
+	WITH_CONSTANT(OP_SUB_RC, r, -, r)
+	WITH_CONSTANT(OP_MUL_RC, r, *, r)
+	WITH_CONSTANT(OP_EQ_RC, b, ==, r)
+	WITH_CONSTANT(OP_LT_RC, b, <, r)
+	WITH_CONSTANT(OP_GT_RC, b, >, r)
+	WITH_VARIABLE(OP_ADD_IV, i, +, i, IsInt, GetInt)
+	WITH_VARIABLE(OP_SUB_IV, i, -, i, IsInt, GetInt)
+	WITH_VARIABLE(OP_MUL_IV, i, *, i, IsInt, GetInt)
+	WITH_VARIABLE(OP_EQ_IV, b, ==, i, IsInt, GetInt)
+	WITH_VARIABLE(OP_LT_IV, b, <, i, IsInt, GetInt)
+	WITH_VARIABLE(OP_GT_IV, b, >, i, IsInt, GetInt)
+	WITH_VARIABLE(OP_ADD_RV, r, +, r, IsReal, GetReal)
+	WITH_VARIABLE(OP_SUB_RV, r, -, r, IsReal, GetReal)
+	WITH_VARIABLE(OP_MUL_RV, r, *, r, IsReal, GetReal)
+	WITH_VARIABLE(OP_EQ_RV, b, ==, r, IsReal, GetReal)
+	WITH_VARIABLE(OP_LT_RV, b, <, r, IsReal, GetReal)
+	WITH_VARIABLE(OP_GT_RV, b, >, r, IsReal, GetReal)
+#undef WITH_CONSTANT
+#undef WITH_VARIABLE
+
+	TARGET(OP_JUMP):
+		pc = code + pc->a;
+		DISPATCH();
+	TARGET(OP_JUMP_FALSE):
+		pc = (--sp)->b ? pc + 1 : code + pc->a;
+		DISPATCH();
+	TARGET(OP_AND_JUMP):
+		if (!sp[-1].b)
+		{
+			pc = code + pc->a;
+			DISPATCH();
+		}
+		sp--;
+		pc++;
+		DISPATCH();
+	TARGET(OP_OR_JUMP):
+		if (sp[-1].b)
+		{
+			pc = code + pc->a;
+			DISPATCH();
+		}
+		sp--;
+		pc++;
+		DISPATCH();
+
+	//Written as the Value they stand for, for the same formatting
+	TARGET(OP_WRITE_I):
+		out << Value((--sp)->i);
+		pc++;
+		DISPATCH();
+	TARGET(OP_WRITE_R):
+		out << Value((--sp)->r);
+		pc++;
+		DISPATCH();
+	TARGET(OP_WRITE_B):
+		out << Value((--sp)->b);
+		pc++;
+		DISPATCH();
+	TARGET(OP_WRITE_S):
+		out << *(--sp)->s;
+		pc++;
+		DISPATCH();
+	TARGET(OP_WRITELN):
+		out << "\n";
+		pc++;
+		DISPATCH();
+
+	TARGET(OP_HALT):
+		return true;
+
+#ifndef VM_COMPUTED_GOTO
+	default:
+		return true;
+	}
+	}
+#endif
+#undef TARGET
+#undef DISPATCH
+#undef COUNT
+
+uninitialized:
+	ParseError(ctx, chunk.Line(pc - code), "Using uninitialzied variable");
+	return false;
+divisionByZero:
+	ParseError(ctx, chunk.Line(pc - code), "Illegal division by zero");
+	return false;
+divisionOverflow:
+	ParseError(ctx, chunk.Line(pc - code), "Integer division overflow");
+	return false;
+}
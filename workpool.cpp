@@ -0,0 +1,107 @@
+/*
+Description: Work-stealing pool for running many independent tasks
+*/
+
+#include "workpool.h"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+//One worker's pending task indices
+struct WorkQueue {
+	mutex	lock;
+	deque<size_t>	tasks;
+};
+
+}
+
+WorkPool::WorkPool(unsigned threads) : threads(threads > 0 ? threads : 1)
+{
+}
+
+void WorkPool::Run(size_t n, const function<void(size_t)>& task)
+{
+	unsigned nworkers = n < threads ? (n > 0 ? n : 1) : threads;
+	vector<unique_ptr<WorkQueue>> queues;
+	for (unsigned w = 0; w < nworkers; w++)
+	{
+		queues.emplace_back(new WorkQueue);
+		for (size_t i = n * w / nworkers; i < n * (w + 1) / nworkers; i++)
+		{
+			queues[w]->tasks.push_back(i);
+		}
+	}
+
+	auto worker = [&](unsigned self) {
+		WorkQueue& mine = *queues[self];
+		while (true)
+		{
+			size_t next = n;
+			{
+				lock_guard<mutex> guard(mine.lock);
+				if (!mine.tasks.empty())
+				{
+					next = mine.tasks.front();
+					mine.tasks.pop_front();
+				}
+			}
+			if (next < n)
+			{
+				task(next);
+				continue;
+			}
+
+			//Out of work: steal half of the fullest queue
+			WorkQueue* victim = nullptr;
+			size_t most = 0;
+			for (unsigned w = 0; w < nworkers; w++)
+			{
+				if (w == self)
+				{
+					continue;
+				}
+				lock_guard<mutex> guard(queues[w]->lock);
+				if (queues[w]->tasks.size() > most)
+				{
+					most = queues[w]->tasks.size();
+					victim = queues[w].get();
+				}
+			}
+			if (!victim)
+			{
+				return;
+			}
+
+			deque<size_t> stolen;
+			{
+				lock_guard<mutex> guard(victim->lock);
+				size_t take = (victim->tasks.size() + 1) / 2;
+				for (size_t k = 0; k < take; k++)
+				{
+					stolen.push_front(victim->tasks.back());
+					victim->tasks.pop_back();
+				}
+			}
+			if (!stolen.empty())
+			{
+				lock_guard<mutex> guard(mine.lock);
+				mine.tasks.insert(mine.tasks.end(), stolen.begin(), stolen.end());
+			}
+		}
+	};
+
+	vector<thread> pool;
+	for (unsigned w = 1; w < nworkers; w++)
+	{
+		pool.emplace_back(worker, w);
+	}
+	worker(0);
+	for (thread& t : pool)
+	{
+		t.join();
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef WORKPOOL_H_
+#define WORKPOOL_H_
+
+#include <cstddef>
+#include <functional>
+
+using namespace std;
+
+//Runs a batch of independent tasks on a fixed number of threads. Each
+//worker starts with an even share of the task indices in its own queue and
+//takes from the front of it; a worker whose queue is empty steals half of
+//the back of the fullest other queue, so uneven task costs still keep
+//every thread busy.
+class WorkPool {
+	unsigned	threads;
+
+public:
+	explicit WorkPool(unsigned threads);
+
+	unsigned	Threads() const { return threads; }
+
+	//Calls task(i) once for every i in [0, n) and returns when all are done.
+	//task must not throw.
+	void	Run(size_t n, const function<void(size_t)>& task);
+};
+
+#endif /* WORKPOOL_H_ */